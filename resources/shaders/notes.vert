@@ -1,8 +1,7 @@
 #version 330
 
 layout(location = 0) in vec2 v;
-layout(location = 1) in vec4 id; //note id, start, duration, is minor
-layout(location = 2) in float channel; //note id, start, duration, is minor
+layout(location = 1) in uvec2 note; //start, then key, is minor, channel, track and duration
 
 uniform float time;
 uniform float mainSpeed;
@@ -12,6 +11,16 @@ uniform float keyboardHeight = 0.25;
 uniform int minNoteMajor;
 uniform float notesCount;
 
+#define CHANNELS_COUNT 8
+#define NOTES_START_UNITS 4096.0
+#define NOTES_DURATION_UNITS 1024.0
+
+// Set mode (channel, track or key) and split key.
+uniform int setMode = 0;
+uniform int setKey = 64;
+
+const int keyShifts[12] = int[](0, 0, 1, 1, 2, 3, 3, 4, 4, 5, 5, 6);
+
 out INTERFACE {
 	vec2 uv;
 	vec2 noteSize;
@@ -22,9 +31,23 @@ out INTERFACE {
 
 void main(){
 	
-	float scalingFactor = id.w != 0.0 ? minorsWidth : 1.0;
+	// Unpack note data.
+	uint key = note.y & 127u;
+	float isMinor = float((note.y >> 7u) & 1u);
+	uint channel = (note.y >> 8u) & 15u;
+	uint track = (note.y >> 12u) & 7u;
+	float start = float(note.x) / NOTES_START_UNITS;
+	// Duration as a small float: 4 bits exponent, 13 bits mantissa, exact below 2^14 units.
+	uint durationBits = note.y >> 15u;
+	uint exponent = durationBits >> 13u;
+	uint mantissa = durationBits & 8191u;
+	uint durationUnits = exponent == 0u ? mantissa : ((mantissa | 8192u) << (exponent - 1u));
+	float duration = float(durationUnits) / NOTES_DURATION_UNITS;
+	float keyId = float(int(key / 12u) * 7 + keyShifts[key % 12u]);
+
+	float scalingFactor = isMinor != 0.0 ? minorsWidth : 1.0;
 	// Size of the note : width, height based on duration and current speed.
-	Out.noteSize = vec2(0.9*2.0/notesCount * scalingFactor, id.z*mainSpeed);
+	Out.noteSize = vec2(0.9*2.0/notesCount * scalingFactor, duration*mainSpeed);
 	
 	// Compute note shift.
 	// Horizontal shift based on note id, width of keyboard, and if the note is minor or not.
@@ -32,19 +55,21 @@ void main(){
 	//float a = (1.0/(notesCount-1.0)) * (2.0 - 2.0/notesCount);
 	//float b = -1.0 + 1.0/notesCount;
 	// This should be in -1.0, 1.0.
-	// input: id.x is in [0 MAJOR_COUNT]
+	// input: keyId is in [0 MAJOR_COUNT]
 	// we want minNote to -1+1/c, maxNote to 1-1/c
 	float a = 2.0;
 	float b = -notesCount + 1.0 - 2.0 * float(minNoteMajor);
 
-	float horizLoc = (id.x * a + b + id.w) / notesCount;
-	float vertLoc = (Out.noteSize.y * 0.5 + (2.0 * keyboardHeight - 1.0)) + mainSpeed * (id.y - time);
+	float horizLoc = (keyId * a + b + isMinor) / notesCount;
+	float vertLoc = (Out.noteSize.y * 0.5 + (2.0 * keyboardHeight - 1.0)) + mainSpeed * (start - time);
 	vec2 noteShift = vec2(horizLoc, vertLoc);
 	
 	// Scale uv.
 	Out.uv = Out.noteSize * v;
-	Out.isMinor = id.w;
-	Out.channel = channel;
+	Out.isMinor = isMinor;
+	// Set of the note, following the current mode.
+	uint set = setMode == 0 ? channel : (setMode == 1 ? track : (int(key) < setKey ? 0u : 1u));
+	Out.channel = float(set % uint(CHANNELS_COUNT));
 	// Output position.
 	gl_Position = vec4(Out.noteSize * v + noteShift, 0.0 , 1.0) ;
 	
@@ -3,16 +3,15 @@
 
 layout(location = 0) in vec2 v;
 
-uniform float time;
 uniform float scale;
 uniform vec3 baseColor[CHANNELS_COUNT];
 uniform vec2 inverseScreenSize;
 uniform sampler2D textureParticles;
 uniform vec2 inverseTextureSize;
 
-uniform int globalId;
-uniform float duration;
-uniform int channel;
+// Note, set, elapsed time and duration of each particles system.
+uniform samplerBuffer systems;
+uniform int particlesPerSystem;
 
 uniform int texCount;
 uniform float colorScale;
@@ -41,7 +40,16 @@ float rand(vec2 co){
 
 
 void main(){
-	Out.id = float(gl_InstanceID % texCount);
+	// Find the particles system and the particle in it.
+	int systemId = gl_InstanceID / particlesPerSystem;
+	int localId = gl_InstanceID % particlesPerSystem;
+	vec4 system = texelFetch(systems, systemId);
+	int globalId = int(system.x);
+	int channel = int(system.y);
+	float time = system.z;
+	float duration = system.w;
+
+	Out.id = float(localId % texCount);
 	Out.uv = v + 0.5;
 	// Fade color based on time.
 	Out.color = vec4(colorScale * baseColor[channel], 1.0-time*time);
@@ -50,7 +58,7 @@ void main(){
 	float particlesCount = 1.0/inverseTextureSize.y;
 	
 	// Pick particle id at random.
-	float particleId = float(gl_InstanceID) + floor(particlesCount * 10.0 * rand(vec2(globalId,globalId)));
+	float particleId = float(localId) + floor(particlesCount * 10.0 * rand(vec2(globalId,globalId)));
 	float textureId = mod(particleId,particlesCount);
 	float particleShift = floor(particleId/particlesCount);
 	
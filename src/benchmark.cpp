@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <limits>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "midi/MIDIFile.h"
+#include "midi/MappedFile.h"
+#include "midi/PlaybackCursor.h"
+
+void printHelp(){
+	std::cout << "---- Infos ---- MIDIVisualizer Benchmark --------" << std::endl
+	<< "Measure each step of MIDI loading and playback queries, results are printed as JSON." << std::endl
+	<< "Usage: benchmark [--option value]... file.mid..." << std::endl
+	<< "\t--threads   number of threads used for loading, 0 for all cores (default 0)" << std::endl
+	<< "\t--queries   number of queries for each query benchmark (default 100000)" << std::endl
+	<< "\t--repeat    number of runs of each step, the fastest one is kept (default 3)" << std::endl
+	<< "--------------------------------------------" << std::endl;
+}
+
+/// Peak resident memory of the process so far, in bytes.
+uint64_t peakMemory(){
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))){
+		return uint64_t(counters.PeakWorkingSetSize);
+	}
+	return 0;
+#else
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0){
+		return 0;
+	}
+#ifdef __APPLE__
+	return uint64_t(usage.ru_maxrss);
+#else
+	return uint64_t(usage.ru_maxrss) * 1024u;
+#endif
+#endif
+}
+
+/// Run a step several times and return the fastest duration, in seconds.
+/// The setup is run before each run and is not measured.
+double measure(int repeat, const std::function<void()> & setup, const std::function<void()> & step){
+	double best = std::numeric_limits<double>::max();
+	for(int rid = 0; rid < repeat; ++rid){
+		setup();
+		const auto start = std::chrono::steady_clock::now();
+		step();
+		const auto end = std::chrono::steady_clock::now();
+		best = (std::min)(best, std::chrono::duration<double>(end - start).count());
+	}
+	return best;
+}
+
+/// Discard standard output while loading, so that it only contains the results.
+class SilentOutput {
+
+public:
+
+	SilentOutput() : _buffer(std::cout.rdbuf(nullptr)) {}
+
+	~SilentOutput(){
+		std::cout.rdbuf(_buffer);
+		std::cout.clear();
+	}
+
+private:
+	std::streambuf * _buffer;
+};
+
+class BenchmarkResults {
+
+public:
+
+	/// Add a stage with the throughput of each processed amount (bytes, notes,...).
+	void addStage(const std::string & name, double seconds, const std::vector<std::pair<std::string, double>> & amounts){
+		std::stringstream str;
+		str << "\"" << name << "\": { \"ms\": " << (seconds * 1000.0);
+		for(const auto & amount : amounts){
+			str << ", \"" << amount.first << "\": " << (seconds > 0.0 ? amount.second / seconds : 0.0);
+		}
+		str << " }";
+		_stages.push_back(str.str());
+	}
+
+	void addQueries(const std::string & name, double seconds, size_t count){
+		std::stringstream str;
+		str << "\"" << name << "\": { \"ms\": " << (seconds * 1000.0) << ", \"nsPerQuery\": " << (seconds * 1e9 / double((std::max)(count, size_t(1)))) << " }";
+		_stages.push_back(str.str());
+	}
+
+	std::string stages() const {
+		std::string result;
+		for(size_t sid = 0; sid < _stages.size(); ++sid){
+			result += (sid == 0 ? "\t\t\t\t" : ",\n\t\t\t\t") + _stages[sid];
+		}
+		return result;
+	}
+
+private:
+	std::vector<std::string> _stages;
+};
+
+std::string escape(const std::string & str){
+	std::string result;
+	for(const char c : str){
+		if(c == '"' || c == '\\'){
+			result.push_back('\\');
+		}
+		result.push_back(c);
+	}
+	return result;
+}
+
+/// Benchmark all steps on a file, and return a JSON object. Returns false if the file can't be loaded.
+bool benchmarkFile(const std::string & path, int threads, size_t queries, int repeat, std::string & json){
+
+	MappedFile file;
+	if(!file.open(path) || file.buffer().size < 14){
+		std::cerr << "[ERROR]: Unable to open " << path << "." << std::endl;
+		return false;
+	}
+	const MIDIBuffer buffer = file.buffer();
+	const double megabytes = double(buffer.size) / (1024.0 * 1024.0);
+	BenchmarkResults results;
+
+	LoadOptions options;
+	options.threads = threads;
+
+	// Full load.
+	MIDIFile midiFile;
+	double loadTime = 0.0;
+	try {
+		SilentOutput silent;
+		loadTime = measure(repeat, [](){}, [&midiFile, &path, &options](){
+			midiFile = MIDIFile(path, options);
+		});
+	} catch(...){
+		std::cerr << "[ERROR]: Unable to load " << path << "." << std::endl;
+		return false;
+	}
+	const double notesCount = double(midiFile.notesCount());
+	results.addStage("load", loadTime, {{"MBps", megabytes}, {"notesps", notesCount}});
+
+	// Each loading step separately, following the same order as the full load.
+	uint16_t unitsPerQuarterNote = read16(buffer, 12);
+	if(getBit(unitsPerQuarterNote, 15)){
+		unitsPerQuarterNote = 1;
+	}
+	const std::vector<size_t> trackPositions = MIDIFile::locateTracks(buffer, read16(buffer, 10));
+
+	std::vector<MIDITrack> tracks;
+	const auto readTracks = [&tracks, &trackPositions, &buffer, &options](){
+		tracks.clear();
+		tracks.resize(trackPositions.size());
+		parallelFor(tracks.size(), options.threads, [&tracks, &trackPositions, &buffer, &options](size_t trackId){
+			tracks[trackId].readTrack(buffer, trackPositions[trackId], false, options.pairing);
+		});
+	};
+	results.addStage("readTracks", measure(repeat, [](){}, readTracks), {{"MBps", megabytes}});
+
+	TempoMap tempoMap;
+	const auto extractTempos = [&tracks, &tempoMap, unitsPerQuarterNote](){
+		std::vector<MIDITempo> tempos;
+		for(const auto & track : tracks){
+			track.extractTempos(tempos);
+		}
+		tempoMap = TempoMap(tempos, unitsPerQuarterNote);
+	};
+	results.addStage("extractTempos", measure(repeat, [](){}, extractTempos), {});
+
+	const auto extractNotes = [&tracks, &tempoMap, &options](){
+		parallelFor(tracks.size(), options.threads, [&tracks, &tempoMap](size_t trackId){
+			tracks[trackId].extractNotes(tempoMap, (unsigned int)(trackId));
+		});
+	};
+	// Extraction consumes the tracks, read them again before each run.
+	results.addStage("extractNotes", measure(repeat, readTracks, extractNotes), {{"notesps", notesCount}});
+
+	const auto merge = [&tracks, &options](){
+		MIDIFile::mergeTracks(tracks, options);
+	};
+	results.addStage("merge", measure(repeat, [&readTracks, &extractNotes](){
+		readTracks();
+		extractNotes();
+	}, merge), {{"notesps", notesCount}});
+
+	const auto buildIndices = [&tracks, &options](){
+		MIDIFile::buildIndices(tracks, options.threads);
+	};
+	results.addStage("buildIndices", measure(repeat, [&readTracks, &extractNotes, &merge](){
+		readTracks();
+		extractNotes();
+		merge();
+	}, buildIndices), {{"notesps", notesCount}});
+	tracks.clear();
+
+	// Queries on the loaded file.
+	const size_t fileTracksCount = midiFile.tracksCount();
+	std::vector<MIDINote> notes;
+	results.addStage("getNotes", measure(repeat, [](){}, [&midiFile, &notes, fileTracksCount](){
+		for(size_t trackId = 0; trackId < fileTracksCount; ++trackId){
+			notes.clear();
+			midiFile.getNotes(notes, NoteType::MAJOR, trackId);
+			notes.clear();
+			midiFile.getNotes(notes, NoteType::MINOR, trackId);
+		}
+	}), {{"notesps", notesCount}});
+
+	// Fixed seed so that all runs query the same times.
+	std::mt19937_64 generator(1);
+	std::uniform_real_distribution<double> distribution(0.0, midiFile.duration());
+	std::vector<double> randomTimes(queries);
+	std::vector<double> sequentialTimes(queries);
+	for(size_t qid = 0; qid < queries; ++qid){
+		randomTimes[qid] = distribution(generator);
+		sequentialTimes[qid] = midiFile.duration() * double(qid) / double(queries);
+	}
+
+	ActiveNotesArray actives;
+	const auto activeQueries = [&midiFile, &actives, fileTracksCount](const std::vector<double> & times){
+		for(const double time : times){
+			for(size_t trackId = 0; trackId < fileTracksCount; ++trackId){
+				midiFile.getNotesActive(actives, time, trackId);
+			}
+		}
+	};
+	results.addQueries("getNotesActiveRandom", measure(repeat, [](){}, [&activeQueries, &randomTimes](){
+		activeQueries(randomTimes);
+	}), queries);
+	results.addQueries("getNotesActiveSequential", measure(repeat, [](){}, [&activeQueries, &sequentialTimes](){
+		activeQueries(sequentialTimes);
+	}), queries);
+
+	// Playback, as done by the renderer.
+	PlaybackCursor cursor;
+	results.addQueries("cursorSequential", measure(repeat, [&cursor, &midiFile](){
+		cursor.reset(midiFile.track(0));
+	}, [&cursor, &actives, &sequentialTimes](){
+		for(const double time : sequentialTimes){
+			cursor.update(time);
+			cursor.getNotesActive(actives);
+		}
+	}), queries);
+
+	bool damper = false, sostenuto = false, soft = false;
+	size_t pedalsPressed = 0;
+	results.addQueries("getPedalsActive", measure(repeat, [](){}, [&midiFile, &randomTimes, &damper, &sostenuto, &soft, &pedalsPressed, fileTracksCount](){
+		for(const double time : randomTimes){
+			for(size_t trackId = 0; trackId < fileTracksCount; ++trackId){
+				midiFile.getPedalsActive(damper, sostenuto, soft, time, trackId);
+				pedalsPressed += size_t(damper);
+			}
+		}
+	}), queries);
+
+	std::stringstream str;
+	str << "\t\t{\n"
+		<< "\t\t\t\"path\": \"" << escape(path) << "\",\n"
+		<< "\t\t\t\"size\": " << buffer.size << ",\n"
+		<< "\t\t\t\"tracks\": " << trackPositions.size() << ",\n"
+		<< "\t\t\t\"notes\": " << midiFile.notesCount() << ",\n"
+		<< "\t\t\t\"duration\": " << midiFile.duration() << ",\n"
+		<< "\t\t\t\"stages\": {\n" << results.stages() << "\n\t\t\t}\n"
+		<< "\t\t}";
+	json = str.str();
+	return true;
+}
+
+int main( int argc, char** argv) {
+
+	if (argc < 2) {
+		printHelp();
+		return 0;
+	}
+
+	int threads = 0;
+	size_t queries = 100000;
+	int repeat = 3;
+	std::vector<std::string> paths;
+	for(int aid = 1; aid < argc; ++aid){
+		const std::string arg(argv[aid]);
+		if(arg.size() > 2 && arg.substr(0, 2) == "--" && aid + 1 < argc){
+			const char * value = argv[++aid];
+			if(arg == "--threads"){
+				threads = std::atoi(value);
+			} else if(arg == "--queries"){
+				queries = size_t(std::strtoull(value, nullptr, 10));
+			} else if(arg == "--repeat"){
+				repeat = (std::max)(1, std::atoi(value));
+			} else {
+				std::cerr << "[WARN]: Unknown option " << arg << "." << std::endl;
+			}
+		} else {
+			paths.push_back(arg);
+		}
+	}
+
+	std::vector<std::string> files;
+	for(const auto & path : paths){
+		std::cerr << "[INFO]: Benchmarking " << path << "." << std::endl;
+		std::string json;
+		if(benchmarkFile(path, threads, queries, repeat, json)){
+			files.push_back(json);
+		}
+	}
+
+	std::cout << "{\n"
+		<< "\t\"threads\": " << threads << ",\n"
+		<< "\t\"queries\": " << queries << ",\n"
+		<< "\t\"repeat\": " << repeat << ",\n"
+		<< "\t\"files\": [\n";
+	for(size_t fid = 0; fid < files.size(); ++fid){
+		std::cout << files[fid] << (fid + 1 < files.size() ? ",\n" : "\n");
+	}
+	// The peak is a process-wide high-water mark, it can't be attributed to each file.
+	std::cout << "\t],\n"
+		<< "\t\"peakRSS\": " << peakMemory() << "\n}" << std::endl;
+	return files.size() == paths.size() ? 0 : 1;
+}
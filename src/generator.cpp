@@ -0,0 +1,401 @@
+#include <stdio.h>
+#include <cstdint>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Ticks per quarter note, densities are expressed in seconds at the initial 120 BPM.
+#define GENERATOR_PPQ 960
+#define GENERATOR_TICKS_PER_SECOND (2.0 * GENERATOR_PPQ)
+#define GENERATOR_DEFAULT_TEMPO 500000
+
+void printHelp(){
+	std::cout << "---- Infos ---- MIDIVisualizer Generator --------" << std::endl
+	<< "Generate a synthetic MIDI file for parsing and rendering tests." << std::endl
+	<< "The same settings and seed always produce the exact same file." << std::endl
+	<< "Usage: generator path/to/output.mid [--option value]..." << std::endl
+	<< "\t-h, --help          display this help" << std::endl
+	<< "\t--seed              seed of the random generator (default 1)" << std::endl
+	<< "\t--duration          duration in seconds (default 60)" << std::endl
+	<< "\t--tracks            number of note tracks (default 16)" << std::endl
+	<< "\t--notes-per-second  notes per second, over all tracks (default 1000)" << std::endl
+	<< "\t--polyphony         maximum simultaneous notes per track (default 8)" << std::endl
+	<< "\t--tempo-changes     tempo changes per second (default 0.5)" << std::endl
+	<< "\t--pedals            pedal presses per second per track (default 0.2)" << std::endl
+	<< "\t--running-status    ratio of eligible events using running status, in [0,1] (default 1)" << std::endl
+	<< "\t--sysex             sysex messages per second per track (default 0)" << std::endl
+	<< "\t--sysex-size        sysex payload size in bytes (default 16)" << std::endl
+	<< "\t--sysex-packets     number of packets each sysex is split into (default 1)" << std::endl
+	<< "--------------------------------------------" << std::endl;
+}
+
+/// Small portable generator, so that files are identical on all platforms.
+class Random {
+
+public:
+
+	Random(uint64_t seed) : _state(seed) {}
+
+	uint64_t next(){
+		// SplitMix64.
+		uint64_t z = (_state += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+	/// Uniform in [0,1).
+	double uniform(){
+		return double(next() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	/// Uniform in [min, max].
+	int range(int min, int max){
+		return min + int(next() % uint64_t(max - min + 1));
+	}
+
+private:
+	uint64_t _state;
+};
+
+struct GeneratorSettings {
+	uint64_t seed = 1;
+	double duration = 60.0;
+	int tracks = 16;
+	double notesPerSecond = 1000.0;
+	int polyphony = 8;
+	double tempoChanges = 0.5;
+	double pedals = 0.2;
+	double runningStatus = 1.0;
+	double sysex = 0.0;
+	int sysexSize = 16;
+	int sysexPackets = 1;
+};
+
+/// Event waiting to be written, sysex and meta content is generated at write time.
+struct GeneratorEvent {
+
+	enum Kind : uint8_t {
+		RELEASE = 0, ///< Note releases go first when simultaneous with other events.
+		CHANNEL, TEMPO, SYSEX
+	};
+
+	uint64_t tick;
+	uint32_t order;
+	uint8_t kind;
+	uint8_t data[3];
+
+	bool operator<(const GeneratorEvent & other) const {
+		if(tick != other.tick){
+			return tick < other.tick;
+		}
+		const bool release = kind == RELEASE;
+		const bool otherRelease = other.kind == RELEASE;
+		if(release != otherRelease){
+			return release;
+		}
+		return order < other.order;
+	}
+};
+
+class TrackWriter {
+
+public:
+
+	TrackWriter(uint64_t seed) : _random(seed) {}
+
+	void writeVarLen(uint64_t value){
+		uint8_t bytes[10];
+		int count = 0;
+		do {
+			bytes[count++] = uint8_t(value & 0x7F);
+			value >>= 7;
+		} while(value > 0);
+		while(count > 1){
+			_data.push_back(char(bytes[--count] | 0x80));
+		}
+		_data.push_back(char(bytes[0]));
+	}
+
+	void writeDelta(uint64_t tick){
+		writeVarLen(tick - _tick);
+		_tick = tick;
+	}
+
+	void writeChannel(uint64_t tick, const uint8_t data[3], double runningStatus){
+		writeDelta(tick);
+		// Only skip the status byte when allowed and requested.
+		const bool skip = data[0] == _status && _random.uniform() < runningStatus;
+		if(!skip){
+			_data.push_back(char(data[0]));
+		}
+		_data.push_back(char(data[1]));
+		_data.push_back(char(data[2]));
+		_status = data[0];
+	}
+
+	void writeMeta(uint64_t tick, uint8_t type, const std::string & content){
+		writeDelta(tick);
+		_data.push_back(char(0xFF));
+		_data.push_back(char(type));
+		writeVarLen(content.size());
+		_data.insert(_data.end(), content.begin(), content.end());
+		// Don't rely on running status surviving non-channel events.
+		_status = 0;
+	}
+
+	void writeTempo(uint64_t tick, uint32_t tempo){
+		const char content[3] = { char((tempo >> 16) & 0xFF), char((tempo >> 8) & 0xFF), char(tempo & 0xFF) };
+		writeMeta(tick, 0x51, std::string(content, 3));
+	}
+
+	void writeSysex(uint64_t tick, int size, int packets){
+		// The first packet starts with F0, the next ones are F7 continuations, the last one ends with F7.
+		packets = (std::max)(1, (std::min)(packets, size + 1));
+		const int packetSize = (size + packets - 1) / packets;
+		int remaining = size;
+		for(int pid = 0; pid < packets; ++pid){
+			const int count = (std::min)(packetSize, remaining);
+			const bool last = pid == packets - 1;
+			writeDelta(pid == 0 ? tick : _tick);
+			_data.push_back(char(pid == 0 ? 0xF0 : 0xF7));
+			writeVarLen(uint64_t(count + (last ? 1 : 0)));
+			for(int bid = 0; bid < count; ++bid){
+				_data.push_back(char(_random.next() & 0x7F));
+			}
+			if(last){
+				_data.push_back(char(0xF7));
+			}
+			remaining -= count;
+		}
+		_status = 0;
+	}
+
+	void writeEvents(std::vector<GeneratorEvent> & events, const GeneratorSettings & settings){
+		std::sort(events.begin(), events.end());
+		for(const GeneratorEvent & event : events){
+			if(event.kind == GeneratorEvent::TEMPO){
+				const uint32_t tempo = (uint32_t(event.data[0]) << 16) | (uint32_t(event.data[1]) << 8) | uint32_t(event.data[2]);
+				writeTempo(event.tick, tempo);
+			} else if(event.kind == GeneratorEvent::SYSEX){
+				writeSysex(event.tick, settings.sysexSize, settings.sysexPackets);
+			} else {
+				writeChannel(event.tick, event.data, settings.runningStatus);
+			}
+		}
+	}
+
+	/// Write the end of track and the chunk to the file.
+	void flush(std::ofstream & file){
+		writeMeta(_tick, 0x2F, "");
+		const uint32_t length = uint32_t(_data.size());
+		const char header[8] = { 'M', 'T', 'r', 'k', char(length >> 24), char((length >> 16) & 0xFF), char((length >> 8) & 0xFF), char(length & 0xFF) };
+		file.write(header, 8);
+		file.write(_data.data(), _data.size());
+	}
+
+private:
+	Random _random;
+	std::vector<char> _data;
+	uint64_t _tick = 0;
+	uint8_t _status = 0;
+};
+
+uint64_t toTicks(double seconds){
+	return uint64_t(std::floor(seconds * GENERATOR_TICKS_PER_SECOND));
+}
+
+/// Tempo, signature and name, with random tempo changes.
+void generateTempoTrack(const GeneratorSettings & settings, std::ofstream & file){
+	Random random(settings.seed);
+	TrackWriter writer(random.next());
+	writer.writeMeta(0, 0x03, "Tempo");
+	const char signature[4] = { 4, 2, 24, 8 };
+	writer.writeMeta(0, 0x58, std::string(signature, 4));
+	writer.writeTempo(0, GENERATOR_DEFAULT_TEMPO);
+
+	std::vector<GeneratorEvent> events;
+	if(settings.tempoChanges > 0.0){
+		const double period = 1.0 / settings.tempoChanges;
+		const size_t count = size_t(settings.duration * settings.tempoChanges);
+		for(size_t cid = 0; cid < count; ++cid){
+			const double time = (double(cid) + random.uniform()) * period;
+			// Between 60 and 200 BPM.
+			const uint32_t tempo = uint32_t(random.range(300000, 1000000));
+			GeneratorEvent event;
+			event.tick = (std::max)(toTicks(time), uint64_t(1));
+			event.order = uint32_t(cid);
+			event.kind = GeneratorEvent::TEMPO;
+			event.data[0] = uint8_t(tempo >> 16);
+			event.data[1] = uint8_t((tempo >> 8) & 0xFF);
+			event.data[2] = uint8_t(tempo & 0xFF);
+			events.push_back(event);
+		}
+	}
+	writer.writeEvents(events, settings);
+	writer.flush(file);
+}
+
+/// Notes played by independent voices, pedal presses and sysex messages.
+size_t generateNotesTrack(const GeneratorSettings & settings, int track, std::ofstream & file){
+	// Each track has its own sequence, derived from the seed.
+	Random random(settings.seed ^ (0xD1B54A32D192ED03ull * uint64_t(track + 1)));
+	TrackWriter writer(random.next());
+	writer.writeMeta(0, 0x03, "Track " + std::to_string(track));
+
+	const uint8_t channel = uint8_t(track % 16);
+	std::vector<GeneratorEvent> events;
+	uint32_t order = 0;
+	size_t notesCount = 0;
+
+	const auto addEvent = [&events, &order](double time, uint8_t kind, uint8_t a, uint8_t b, uint8_t c){
+		GeneratorEvent event;
+		event.tick = toTicks(time);
+		event.order = order++;
+		event.kind = kind;
+		event.data[0] = a;
+		event.data[1] = b;
+		event.data[2] = c;
+		events.push_back(event);
+	};
+
+	// Each voice plays at most one note in each of its slots, so the polyphony is bounded.
+	const double notesPerSecond = settings.notesPerSecond / double(settings.tracks);
+	if(notesPerSecond > 0.0 && settings.polyphony > 0){
+		const double slot = double(settings.polyphony) / notesPerSecond;
+		const size_t slotsCount = size_t(settings.duration / slot);
+		events.reserve(2 * slotsCount * size_t(settings.polyphony));
+		for(int vid = 0; vid < settings.polyphony; ++vid){
+			// Shift voices so that they don't all start at the same time.
+			const double shift = slot * double(vid) / double(settings.polyphony);
+			for(size_t sid = 0; sid < slotsCount; ++sid){
+				const double length = slot * (0.2 + 0.75 * random.uniform());
+				const double start = shift + double(sid) * slot + (slot - length) * random.uniform();
+				const uint8_t key = uint8_t(random.range(21, 108));
+				const uint8_t velocity = uint8_t(random.range(1, 127));
+				if(toTicks(start + length) <= toTicks(start)){
+					continue;
+				}
+				addEvent(start, GeneratorEvent::CHANNEL, uint8_t(0x90 | channel), key, velocity);
+				// Note on with a zero velocity allows running status between presses and releases.
+				if(settings.runningStatus > 0.0){
+					addEvent(start + length, GeneratorEvent::RELEASE, uint8_t(0x90 | channel), key, 0);
+				} else {
+					addEvent(start + length, GeneratorEvent::RELEASE, uint8_t(0x80 | channel), key, 64);
+				}
+				++notesCount;
+			}
+		}
+	}
+
+	if(settings.pedals > 0.0){
+		const double slot = 1.0 / settings.pedals;
+		const size_t count = size_t(settings.duration * settings.pedals);
+		const uint8_t types[3] = { 64, 66, 67 };
+		for(size_t pid = 0; pid < count; ++pid){
+			const double length = slot * (0.1 + 0.8 * random.uniform());
+			const double start = double(pid) * slot + (slot - length) * random.uniform();
+			// Mostly damper.
+			const int draw = random.range(0, 5);
+			const uint8_t type = types[draw < 4 ? 0 : draw - 3];
+			addEvent(start, GeneratorEvent::CHANNEL, uint8_t(0xB0 | channel), type, uint8_t(random.range(64, 127)));
+			addEvent(start + length, GeneratorEvent::CHANNEL, uint8_t(0xB0 | channel), type, uint8_t(random.range(0, 63)));
+		}
+	}
+
+	if(settings.sysex > 0.0){
+		const size_t count = size_t(settings.duration * settings.sysex);
+		for(size_t sid = 0; sid < count; ++sid){
+			addEvent((double(sid) + random.uniform()) / settings.sysex, GeneratorEvent::SYSEX, 0, 0, 0);
+		}
+	}
+
+	writer.writeEvents(events, settings);
+	writer.flush(file);
+	return notesCount;
+}
+
+int main( int argc, char** argv) {
+
+	if (argc < 2) {
+		printHelp();
+		return 0;
+	}
+	for(int aid = 1; aid < argc; ++aid){
+		const std::string arg(argv[aid]);
+		if(arg == "-h" || arg == "--help"){
+			printHelp();
+			return 0;
+		}
+	}
+	const std::string outputPath(argv[1]);
+	if(outputPath.compare(0, 2, "--") == 0){
+		std::cerr << "[ERROR]: The first argument should be the output path, not " << outputPath << "." << std::endl;
+		printHelp();
+		return 1;
+	}
+
+	GeneratorSettings settings;
+	for(int aid = 2; aid < argc; aid += 2){
+		const std::string key(argv[aid]);
+		if(aid + 1 >= argc){
+			std::cerr << "[ERROR]: Missing value for option " << key << "." << std::endl;
+			return 1;
+		}
+		const char * value = argv[aid + 1];
+		if(key == "--seed"){
+			settings.seed = std::strtoull(value, nullptr, 10);
+		} else if(key == "--duration"){
+			settings.duration = std::atof(value);
+		} else if(key == "--tracks"){
+			settings.tracks = std::atoi(value);
+		} else if(key == "--notes-per-second"){
+			settings.notesPerSecond = std::atof(value);
+		} else if(key == "--polyphony"){
+			settings.polyphony = std::atoi(value);
+		} else if(key == "--tempo-changes"){
+			settings.tempoChanges = std::atof(value);
+		} else if(key == "--pedals"){
+			settings.pedals = std::atof(value);
+		} else if(key == "--running-status"){
+			settings.runningStatus = std::atof(value);
+		} else if(key == "--sysex"){
+			settings.sysex = std::atof(value);
+		} else if(key == "--sysex-size"){
+			settings.sysexSize = std::atoi(value);
+		} else if(key == "--sysex-packets"){
+			settings.sysexPackets = std::atoi(value);
+		} else {
+			std::cerr << "[WARN]: Unknown option " << key << "." << std::endl;
+		}
+	}
+	if(settings.tracks < 1 || settings.tracks > 65534 || settings.duration <= 0.0 || settings.sysexSize < 0){
+		std::cerr << "[ERROR]: Invalid settings." << std::endl;
+		return 1;
+	}
+
+	std::ofstream file(outputPath, std::ios::binary);
+	if(!file.is_open()){
+		std::cerr << "[ERROR]: Unable to open output file " << outputPath << "." << std::endl;
+		return 1;
+	}
+
+	// Header: format 1, a tempo track followed by the note tracks.
+	const uint16_t tracksCount = uint16_t(settings.tracks + 1);
+	const char header[14] = { 'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1, char(tracksCount >> 8), char(tracksCount & 0xFF), char(GENERATOR_PPQ >> 8), char(GENERATOR_PPQ & 0xFF) };
+	file.write(header, 14);
+
+	generateTempoTrack(settings, file);
+	size_t notesCount = 0;
+	for(int tid = 0; tid < settings.tracks; ++tid){
+		notesCount += generateNotesTrack(settings, tid, file);
+	}
+	file.close();
+
+	std::cout << "[INFO]: Generated " << notesCount << " notes in " << settings.tracks << " tracks at " << outputPath << "." << std::endl;
+	return 0;
+}
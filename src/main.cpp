@@ -228,15 +228,6 @@ int main( int argc, char** argv) {
 	// Create the renderer.
 	Renderer renderer(isw, ish, fullscreen);
 
-	// Load midi file, graphics setup.
-	if(!renderer.loadFile(midiFilePath)){
-		// File not found, probably (error message handled locally).
-		renderer.clean();
-		glfwDestroyWindow(window);
-		glfwTerminate();
-		return 3;
-	}
-
 	// Apply custom state.
 	State state;
 	if(args.count("config") > 0){
@@ -244,7 +235,17 @@ int main( int argc, char** argv) {
 	}
 	// Apply any extra display argument on top of the (optional) config.
 	state.load(args);
+	// Apply it before loading, as some settings affect the loading itself.
 	renderer.setState(state);
+
+	// Load midi file, graphics setup.
+	if(!renderer.loadFile(midiFilePath)){
+		// File not found, probably (error message handled locally).
+		renderer.clean();
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		return 3;
+	}
 	
 	// Define utility pointer for callbacks (can be obtained back from inside the callbacks).
 	glfwSetWindowUserPointer(window, &renderer);
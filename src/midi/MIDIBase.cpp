@@ -1,10 +1,11 @@
+#include <algorithm>
 #include "MIDIBase.h"
 
-MIDINote::MIDINote(short aNote, double aStart, double aDuration, short aVelocity, short aChannel, unsigned int trackId) : start(aStart), duration(aDuration), track(trackId), set(0), note(aNote), velocity(aVelocity), channel(aChannel) {
+MIDINote::MIDINote() : start(0.0), duration(0.0), track(0), note(0), velocity(0), channel(0), multiplicity(1) {
 
 }
 
-MIDIEvent::MIDIEvent(EventCategory aCategory, uint8_t aType, size_t aDelta, std::vector<short> aData) : category(aCategory), type(aType), delta(aDelta), data(aData) {
+MIDINote::MIDINote(short aNote, double aStart, double aDuration, short aVelocity, short aChannel, unsigned int trackId) : start(aStart), duration(aDuration), track(trackId), note(aNote), velocity(aVelocity), channel(aChannel), multiplicity(1) {
 
 }
 
@@ -16,6 +17,10 @@ MIDITempo::MIDITempo(size_t astart, unsigned int atempo) : start(astart), tempo(
 	
 }
 
+MIDIPedal::MIDIPedal() : start(0.0), duration(0.0), type(PedalType::DAMPER) {
+
+}
+
 MIDIPedal::MIDIPedal(PedalType aType, double aStart, double aDuration) : start(aStart), duration(aDuration), type(aType) {
 
 }
@@ -24,17 +29,23 @@ void MIDINote::print() const {
 	std::cout << "[INFO]: Note " << note << " (" << duration << "s at "<< start << "s), on channel " << channel << " with velocity " << velocity << "." << std::endl;
 }
 
-void MIDIEvent::print() const {
+void MIDIEvent::print(const uint8_t * payload) const {
 	if(category == EventCategory::SYSTEM){
-		std::cout << "[INFO]: " << "Sysex event (" << delta << "): type is "<< std::hex << std::showbase << type << std::dec << ", length is " << data.size() << std::endl;
+		const std::string name = (type != 0xF0 && type != 0xF7) ? "System event" : (data[0] == 1 ? "Sysex continuation" : "Sysex event");
+		std::cout << "[INFO]: " << name << " (" << delta << "): type is "<< std::hex << std::showbase << int(type) << std::dec << ", length is " << length << std::endl;
 	} else if (category == EventCategory::META){
-		std::cout << "[INFO]: " << "Meta event (" << delta << "): type is " << metaEventTypeName[static_cast<MetaEventType>(type)] << ", length is " << data.size() << std::endl;
+		std::cout << "[INFO]: " << "Meta event (" << delta << "): type is " << metaEventTypeName[static_cast<MetaEventType>(type)] << ", length is " << length;
+		// Text events content.
+		if(payload && type >= textEvent && type <= cuePoint){
+			std::cout << ", text is \"" << std::string(reinterpret_cast<const char *>(payload), length) << "\"";
+		}
+		std::cout << std::endl;
 	} else if (category == EventCategory::MIDI){
 		const auto typeName = MIDIEventTypeName.find(static_cast<MIDIEventType>(type));
 		if(typeName != MIDIEventTypeName.end()){
-			std::cout << "[INFO]: " << "MIDI Event " << typeName->second << " (" << delta << ") on channel " << data[0] << " with note " << data[1] << " and velocity " << data[2] << "." << std::endl;
+			std::cout << "[INFO]: " << "MIDI Event " << typeName->second << " (" << delta << ") on channel " << int(data[0]) << " with note " << int(data[1]) << " and velocity " << int(data[2]) << "." << std::endl;
 		} else {
-			std::cout << "[INFO]: " << "MIDI Event unknown (" << delta << "), data size " << data.size() << "." << std::endl;
+			std::cout << "[INFO]: " << "MIDI Event unknown (" << delta << ")." << std::endl;
 		}
 	}
 }
@@ -47,83 +58,50 @@ void MIDIPedal::print() const {
 	std::cout << "[INFO]: Pedal " << int(type) << " (at "<< start << ", " << duration << ")." << std::endl;
 }
 
-MIDIEvent MIDIEvent::readMIDIEvent(const std::vector<char> & buffer, size_t & position, size_t delta, uint8_t & previousFirstByte){
-
-	uint8_t firstByte = read8(buffer, position);
-	size_t positionOffset = 1;
-
-	MIDIEventType type = static_cast<MIDIEventType>((firstByte & 0xF0) >> 4);
-	/*if (type == ignoreType) {
-		position += positionOffset;
-		std::cout << "but" << std::endl;
-		return MIDIEvent(midiEvent, static_cast<uint8_t>(type), delta, {});
-	}*/
-
-	uint8_t secondByte = read8(buffer, position+1);
-	uint8_t thirdByte = 0;
-	positionOffset += 1;
-	if(type != programChange && type != channelPressure){
-		thirdByte = read8(buffer, position+2);
-		positionOffset += 1;
-	}
-
-	if(MIDIEventTypeName.count(type) == 0){
-		thirdByte = secondByte;
-		secondByte = firstByte;
-		firstByte = previousFirstByte;
-		positionOffset -= 1;
-	}
-
-	type = static_cast<MIDIEventType>((firstByte & 0xF0) >> 4);
-
-	short channel = firstByte & 0x0F;
-
-	short note = short(secondByte);
-	short velocity = short(thirdByte);
-
-	std::vector<short> data;
-	data.push_back(channel);
-	data.push_back(note);
-	data.push_back(velocity);
-
-	previousFirstByte = firstByte;
-	position += positionOffset;
-
-	return MIDIEvent(EventCategory::MIDI, static_cast<uint8_t>(type), delta, data);
+/// Size of a payload, truncated to the available data.
+static size_t payloadLength(size_t position, size_t end, size_t length){
+	return position < end ? (std::min)(length, end - position) : 0;
 }
 
-
-MIDIEvent MIDIEvent::readMetaEvent(const std::vector<char> & buffer, size_t & position, size_t delta){
-	position += 1; // We already read FF.
+MIDIEvent MIDIEvent::readMetaEvent(const MIDIBuffer & buffer, size_t & position, size_t end, uint32_t delta){
 	MetaEventType type = static_cast<MetaEventType>(read8(buffer, position));
 	position += 1;
 
-	size_t length = readVarLen(buffer, position);
+	const size_t length = payloadLength(position, end, readVarLen(buffer, position, end));
 
-	std::vector<short> data;
-	for(size_t i = 0; i < length; ++i){
-		data.push_back(short(read8(buffer, position + i)));
-	}
+	MIDIEvent event;
+	event.delta = delta;
+	event.offset = position;
+	event.length = uint32_t(length);
+	event.category = EventCategory::META;
+	event.type = static_cast<uint8_t>(type);
+	event.data[0] = event.data[1] = event.data[2] = 0;
 
 	position = position + length;
-
-	return MIDIEvent(EventCategory::META, static_cast<uint8_t>(type), delta, data);
+	return event;
 }
 
 
-MIDIEvent MIDIEvent::readSysexEvent(const std::vector<char> & buffer, size_t & position, size_t delta){
-	uint8_t type = read8(buffer, position);
-	position += 1;
-
-	size_t length = readVarLen(buffer,position);
-
-	std::vector<short> data;
-	for(size_t i = 0; i < length; ++i){
-		data.push_back(short(read8(buffer, position + i)));
+MIDIEvent MIDIEvent::readSysexEvent(const MIDIBuffer & buffer, size_t & position, size_t end, uint32_t delta, uint8_t status, bool & sysexOpen){
+	const size_t length = payloadLength(position, end, readVarLen(buffer, position, end));
+
+	MIDIEvent event;
+	event.delta = delta;
+	event.offset = position;
+	event.length = uint32_t(length);
+	event.category = EventCategory::SYSTEM;
+	event.type = status;
+	event.data[0] = event.data[1] = event.data[2] = 0;
+
+	// 0xF7 either continues an unfinished sysex, or escapes arbitrary bytes.
+	const bool continuation = status == 0xF7 && sysexOpen;
+	event.data[0] = continuation ? 1 : 0;
+	if(status == 0xF0 || continuation){
+		// The message is finished by a packet ending with 0xF7.
+		const size_t lastPosition = position + length - 1;
+		sysexOpen = length == 0 || read8(buffer, lastPosition) != 0xF7;
 	}
 
 	position = position + length;
-
-	return MIDIEvent(EventCategory::SYSTEM, type, delta, data);
+	return event;
 }
-
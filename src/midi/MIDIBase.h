@@ -5,6 +5,8 @@
 
 struct MIDINote {
 
+	MIDINote();
+
 	MIDINote(short aNote, double aStart, double aDuration, short aVelocity, short aChannel, unsigned int trackId);
 
 	void print() const;
@@ -12,14 +14,16 @@ struct MIDINote {
 	double start;
 	double duration;
 	unsigned int track;
-	int set;
 	short note;
 	short velocity;
 	short channel;
+	unsigned int multiplicity; ///< Number of duplicate notes collapsed in this one.
 };
 
 struct MIDIPedal {
 
+	MIDIPedal();
+
 	MIDIPedal(PedalType aType, double aStart, double aDuration);
 
 	void print() const;
@@ -29,22 +33,74 @@ struct MIDIPedal {
 	PedalType type;
 };
 
-struct MIDIEvent {
-
-	MIDIEvent(EventCategory aCategory, uint8_t aType, size_t aDelta, std::vector<short> aData);
-
-	void print() const;
-
-	static MIDIEvent readMIDIEvent(const std::vector<char> & buffer, size_t & position, size_t delta, uint8_t & previousFirstByte);
-
-	static MIDIEvent readMetaEvent(const std::vector<char> & buffer, size_t & position, size_t delta);
+/// Kind of event started by a status byte, and number of data bytes following it for channel and system messages.
+struct MIDIStatus {
+
+	enum Kind : uint8_t {
+		DATA, ///< Not a status byte, running status applies.
+		NOTE, ///< Note on or off.
+		CONTROLLER,
+		SKIPPED, ///< Aftertouch, program change, pitch bend and system messages, not used.
+		SYSEX, ///< Sysex or escape (0xF0 or 0xF7).
+		META
+	};
+
+	constexpr MIDIStatus(uint8_t aKind, uint8_t aLength) : kind(aKind), length(aLength) {}
+
+	/// Decode a status byte, can be evaluated at compile time.
+	static constexpr MIDIStatus decode(uint8_t status){
+		return status < 0x80 ? MIDIStatus(DATA, 0)
+			: status < 0xF0 ? decodeChannel(status >> 4)
+			: (status == 0xF0 || status == 0xF7) ? MIDIStatus(SYSEX, 0)
+			: status == 0xFF ? MIDIStatus(META, 0)
+			: MIDIStatus(SKIPPED, (status == 0xF1 || status == 0xF3) ? 1 : (status == 0xF2 ? 2 : 0));
+	}
+
+	uint8_t kind;
+	uint8_t length;
+
+private:
+
+	static constexpr MIDIStatus decodeChannel(uint8_t type){
+		return (type == noteOn || type == noteOff) ? MIDIStatus(NOTE, 2)
+			: type == controllerChange ? MIDIStatus(CONTROLLER, 2)
+			: MIDIStatus(SKIPPED, (type == programChange || type == channelPressure) ? 1 : 2);
+	}
+};
 
-	static MIDIEvent readSysexEvent(const std::vector<char> & buffer, size_t & position, size_t delta);
+/// Compact event record. Channel events are stored inline,
+/// meta and sysex payloads are referenced by their position in the source buffer and only read on demand.
+struct MIDIEvent {
 
+	/// The payload of meta and sysex events can be provided to print its content.
+	void print(const uint8_t * payload = nullptr) const;
+
+	/// Channel or system event with a known status, reading length data bytes (at most 2) at the given position.
+	static MIDIEvent readMIDIEvent(const MIDIBuffer & buffer, size_t position, uint32_t delta, uint8_t status, uint8_t length){
+		MIDIEvent event;
+		event.delta = delta;
+		event.offset = event.length = 0;
+		event.category = status < 0xF0 ? EventCategory::MIDI : EventCategory::SYSTEM;
+		event.type = status < 0xF0 ? uint8_t(status >> 4) : status;
+		event.data[0] = status & 0x0F;
+		event.data[1] = length > 0 ? read8(buffer, position) : 0;
+		event.data[2] = length > 1 ? read8(buffer, position + 1) : 0;
+		return event;
+	}
+
+	/// Read a meta event, the position is right after the 0xFF status byte. Nothing is read at or past end, the payload is truncated to it.
+	static MIDIEvent readMetaEvent(const MIDIBuffer & buffer, size_t & position, size_t end, uint32_t delta);
+
+	/// Read a sysex packet, the position is right after the 0xF0 or 0xF7 status byte. Nothing is read at or past end, the payload is truncated to it.
+	/// A sysex message can be split in several packets, the following ones starting with 0xF7; sysexOpen tracks if one is in progress.
+	static MIDIEvent readSysexEvent(const MIDIBuffer & buffer, size_t & position, size_t end, uint32_t delta, uint8_t status, bool & sysexOpen);
+
+	size_t offset; ///< Payload position in the source buffer (meta and sysex).
+	uint32_t delta;
+	uint32_t length; ///< Payload size (meta and sysex).
 	EventCategory category;
 	uint8_t type;
-	size_t delta;
-	std::vector<short> data;
+	uint8_t data[3]; ///< Channel, note and velocity (MIDI), 1 in data[0] for sysex continuation packets.
 
 };
 
@@ -64,7 +120,8 @@ struct MIDITempo {
 struct ActiveNoteInfos {
 	float start = 1000000.0f;
 	float duration = 0.0f;
-	int set = -1;
+	unsigned int track = 0;
+	uint8_t channel = 0;
 	bool enabled = false;
 };
 
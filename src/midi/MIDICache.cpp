@@ -0,0 +1,55 @@
+#include <cstring>
+
+#include "MIDICache.h"
+
+/// Round up to the next multiple of 8 bytes.
+static uint64_t align8(uint64_t size){
+	return (size + 7) & ~uint64_t(7);
+}
+
+MIDICache::Layout::Layout(uint64_t notesCount, uint64_t pedalsCount, uint64_t temposCount, uint64_t namesSize){
+	uint64_t offset = align8(sizeof(Header));
+	notesStarts = offset; offset = align8(offset + notesCount * sizeof(double));
+	notesEnds = offset; offset = align8(offset + notesCount * sizeof(double));
+	notesTracks = offset; offset = align8(offset + notesCount * sizeof(uint32_t));
+	notesMultiplicities = offset; offset = align8(offset + notesCount * sizeof(uint32_t));
+	notesKeys = offset; offset = align8(offset + notesCount);
+	notesChannels = offset; offset = align8(offset + notesCount);
+	notesVelocities = offset; offset = align8(offset + notesCount);
+	pedalsStarts = offset; offset = align8(offset + pedalsCount * sizeof(double));
+	pedalsDurations = offset; offset = align8(offset + pedalsCount * sizeof(double));
+	pedalsTypes = offset; offset = align8(offset + pedalsCount);
+	temposStarts = offset; offset = align8(offset + temposCount * sizeof(uint64_t));
+	temposValues = offset; offset = align8(offset + temposCount * sizeof(uint32_t));
+	names = offset; offset = align8(offset + namesSize);
+	totalSize = offset;
+}
+
+uint64_t MIDICache::packOptions(const LoadOptions & options){
+	// Pairing in the first byte, then the deduplication flag, and the tolerance bits in the upper half.
+	uint64_t packed = uint64_t(options.pairing) & 0xFF;
+	if(options.deduplicate){
+		uint32_t toleranceBits = 0;
+		std::memcpy(&toleranceBits, &options.duplicateTolerance, sizeof(float));
+		packed |= (uint64_t(1) << 8) | (uint64_t(toleranceBits) << 32);
+	}
+	return packed;
+}
+
+uint64_t MIDICache::hash(const MIDIBuffer & buffer){
+	// Multiply and shift on 8 bytes words, then on the remaining bytes.
+	const uint64_t prime = 0x9E3779B97F4A7C15ull;
+	uint64_t result = 0xCBF29CE484222325ull ^ (uint64_t(buffer.size) * prime);
+	size_t i = 0;
+	for(; i + 8 <= buffer.size; i += 8){
+		uint64_t word;
+		std::memcpy(&word, buffer.data + i, sizeof(uint64_t));
+		result = (result ^ word) * prime;
+		result ^= result >> 29;
+	}
+	for(; i < buffer.size; ++i){
+		result = (result ^ uint64_t(uint8_t(buffer[i]))) * prime;
+		result ^= result >> 29;
+	}
+	return result;
+}
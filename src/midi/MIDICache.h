@@ -0,0 +1,75 @@
+#ifndef MIDI_CACHE_H
+#define MIDI_CACHE_H
+
+#include "MIDIUtils.h"
+
+/// Binary cache of a loaded MIDI file, stored next to it.
+/// The file is a fixed header followed by arrays aligned on 8 bytes. When loading, each array is copied in bulk
+/// from the memory mapping into the note store, no per-note parsing is needed.
+/// It is only valid for the exact same source content and load options.
+class MIDICache {
+
+public:
+
+	static const uint32_t version = 4;
+
+	static const uint32_t endianness = 0x01020304;
+
+	struct Header {
+		char magic[8]; ///< "MVCACHE"
+		uint32_t version;
+		uint32_t endianness; ///< Detect caches written on a machine with a different byte order.
+		uint64_t sourceHash; ///< Hash of the MIDI file content.
+		uint64_t sourceSize;
+		uint64_t options; ///< Load options affecting the result.
+		uint32_t format;
+		uint32_t unitsPerFrame;
+		uint32_t unitsPerQuarterNote;
+		float framesPerSeconds;
+		int32_t count;
+		double signature;
+		double secondsPerMeasure;
+		double duration;
+		uint64_t notesCount;
+		uint64_t pedalsCount;
+		uint64_t temposCount;
+		uint64_t namesCount; ///< Number of source tracks.
+		uint64_t namesSize; ///< Size of the source tracks names, each one followed by a null character.
+		uint64_t totalSize;
+	};
+
+	/// Position of each array in the file, all notes arrays first, then pedals, tempos and track names.
+	struct Layout {
+
+		Layout(uint64_t notesCount, uint64_t pedalsCount, uint64_t temposCount, uint64_t namesSize);
+
+		uint64_t notesStarts; ///< double
+		uint64_t notesEnds; ///< double
+		uint64_t notesTracks; ///< uint32
+		uint64_t notesMultiplicities; ///< uint32
+		uint64_t notesKeys; ///< uint8
+		uint64_t notesChannels; ///< uint8
+		uint64_t notesVelocities; ///< uint8
+		uint64_t pedalsStarts; ///< double
+		uint64_t pedalsDurations; ///< double
+		uint64_t pedalsTypes; ///< uint8
+		uint64_t temposStarts; ///< uint64
+		uint64_t temposValues; ///< uint32
+		uint64_t names; ///< char
+		uint64_t totalSize;
+	};
+
+	/// Path of the cache for a given MIDI file.
+	static std::string path(const std::string & midiPath){
+		return midiPath + ".mvcache";
+	}
+
+	/// Pack the load options affecting the content of the cache.
+	static uint64_t packOptions(const LoadOptions & options);
+
+	/// Fast 64-bit hash of the content of a file.
+	static uint64_t hash(const MIDIBuffer & buffer);
+
+};
+
+#endif // MIDI_CACHE_H
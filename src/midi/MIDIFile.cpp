@@ -1,57 +1,43 @@
 #include <algorithm>
-#include <iterator>
+#include <cstring>
+#include <cstdio>
 #include <fstream>
+#include <atomic>
 
 #include "MIDIFile.h"
-
-#ifdef _WIN32
-#define NOMINMAX
-#include <windows.h>
-
-WCHAR * widen(const std::string & str){
-	const int size = MultiByteToWideChar(CP_UTF8, 0, str.c_str(), -1, NULL, 0);
-	WCHAR *arr = new WCHAR[size];
-	MultiByteToWideChar(CP_UTF8, 0, str.c_str(), -1, (LPWSTR)arr, size);
-	// Will leak on Windows.
-	return arr;
-}
-
-std::string narrow(WCHAR * str){
-	const int size = WideCharToMultiByte(CP_UTF8, 0, str, -1, NULL, 0, NULL, NULL);
-	std::string res(size - 1, 0);
-	WideCharToMultiByte(CP_UTF8, 0, str, -1, &res[0], size, NULL, NULL);
-	return res;
-}
-
-#else
-
-const char * widen(const std::string & str){
-	return str.c_str();
-}
-std::string narrow(char * str) {
-	return std::string(str);
-}
-
-#endif
+#include "MIDICache.h"
+#include "MappedFile.h"
 
 MIDIFile::MIDIFile(){};
 
-MIDIFile::MIDIFile(const std::string & filePath){
-	std::ifstream input(widen(filePath), std::ios::in|std::ios::binary);
+MIDIFile::MIDIFile(const std::string & filePath, const LoadOptions & options, const std::function<void(float)> & progress) : _path(filePath) {
+	const auto reportProgress = [&progress](float value){
+		if(progress){
+			progress(value);
+		}
+	};
 
-	if(!input.is_open()) {
+	// Map the file, the whole content is then read in place.
+	MappedFile file;
+	if(!file.open(filePath)) {
 		std::cerr << "[ERROR]: Couldn't find file at path " << filePath << std::endl;
 		throw "BadInput";
 	}
-	
-	std::vector<char> buffer;
-	std::copy(std::istreambuf_iterator<char>(input),
-			  std::istreambuf_iterator<char>(),
-			  std::back_inserter(buffer));
-	input.close();
+	const MIDIBuffer buffer = file.buffer();
+
+	// Reuse the result of a previous load if possible.
+	const uint64_t sourceHash = options.cache ? MIDICache::hash(buffer) : 0;
+	const uint64_t cacheOptions = MIDICache::packOptions(options);
+	if(options.cache){
+		if(loadCache(MIDICache::path(filePath), sourceHash, buffer.size, cacheOptions)){
+			std::cout << "[INFO]: Loaded " << _count << " notes from cache." << std::endl;
+			reportProgress(1.0f);
+			return;
+		}
+	}
 
 	// Check midi header
-	if(buffer.size() < 5 || !(buffer[0] == 'M' && buffer[1] == 'T' && buffer[2] == 'h' && buffer[3] == 'd') || read32(buffer, 4) != 6){
+	if(buffer.size < 14 || !(buffer[0] == 'M' && buffer[1] == 'T' && buffer[2] == 'h' && buffer[3] == 'd') || read32(buffer, 4) != 6){
 		std::cerr << "[ERROR]: " << filePath << " is not a midi file." << std::endl;
 		throw "BadInput";
 	}
@@ -74,10 +60,8 @@ MIDIFile::MIDIFile(const std::string & filePath){
 		throw "BadInput";
 	}
 
-	bool shouldMerge = false;
 	if(_format == singleTrack && tracksCount > 1){
 		std::cerr << "[WARN]: " << "Too many tracks, will merge all tracks." << std::endl;
-		shouldMerge = true;
 	}
 
 	// Division mode.
@@ -103,46 +87,99 @@ MIDIFile::MIDIFile(const std::string & filePath){
 		_framesPerSeconds = 0.0f;
 	}
 
-	// Parse tracks.
-	size_t pos = 14;
-	for(size_t trackId = 0; trackId < tracksCount; ++trackId){
+	// Locate all tracks first, using the chunk headers.
+	const std::vector<size_t> trackPositions = locateTracks(buffer, tracksCount);
+
+	// Parse tracks, each one independently.
+	// Parsing is most of the loading time.
+	_tracks.resize(trackPositions.size());
+	std::atomic<size_t> tracksRead(0);
+	parallelFor(_tracks.size(), options.threads, [this, &buffer, &trackPositions, &options, &tracksRead, &reportProgress](size_t trackId){
+		_tracks[trackId].readTrack(buffer, trackPositions[trackId], false, options.pairing);
+		reportProgress(0.7f * float(++tracksRead) / float(_tracks.size()));
+	});
+	for(size_t trackId = 0; trackId < _tracks.size(); ++trackId){
 		std::cout << "[INFO]: " << "Reading track " << trackId << "." << std::endl;
-		_tracks.emplace_back();
-		pos = _tracks.back().readTrack(buffer, pos);
+		_tracks[trackId].printSummary();
+	}
+
+	if(_tracks.empty()){
+		std::cerr << "[ERROR]: " << "No tracks." << std::endl;
+		throw "BadInput";
 	}
 
 	// Extract tempos and the signature.
 	populateTemposAndSignature();
 
 	// Update seconds per measure.
-	_secondsPerMeasure = computeMeasureDuration(_tempos[0].tempo, _signature);
+	_secondsPerMeasure = computeMeasureDuration(_tempoMap[0].tempo, _signature);
 
 	// Convert each track to real notes.
-	for(size_t tid = 0; tid < _tracks.size(); ++tid){
-		auto & track = _tracks[tid];
-		track.extractNotes(_tempos, _unitsPerQuarterNote, tid);
-	}
+	parallelFor(_tracks.size(), options.threads, [this](size_t trackId){
+		_tracks[trackId].extractNotes(_tempoMap, (unsigned int)(trackId));
+	});
+	reportProgress(0.8f);
 
-	// For now, still merge.
-	shouldMerge = true;
-	if(shouldMerge){
-		mergeTracks();
+	// Merged view used by playback queries, the notes of each source track are still indexed separately.
+	const size_t removed = mergeTracks(_tracks, options);
+	if(options.deduplicate){
+		std::cout << "[INFO]: Removed " << removed << " duplicate notes." << std::endl;
 	}
+	reportProgress(0.9f);
+
+	// Index notes and pedals for playback queries.
+	buildIndices(_tracks, options.threads);
+	reportProgress(1.0f);
 
 	// Compute duration.
 	for(const auto & track : _tracks){
-		std::vector<MIDINote> notes;
-		track.getNotes(notes, NoteType::ALL);
-		for(const auto & note : notes){
-			_duration = std::max(_duration, note.start + note.duration);
+		const auto & ends = track.noteStore().ends;
+		for(const double end : ends){
+			_duration = std::max(_duration, end);
+		}
+		_count += int(ends.size());
+	}
+
+	if(options.cache && !saveCache(MIDICache::path(filePath), sourceHash, buffer.size, cacheOptions)){
+		std::cerr << "[WARN]: Unable to write cache for " << filePath << "." << std::endl;
+	}
+}
+
+std::vector<size_t> MIDIFile::locateTracks(const MIDIBuffer & buffer, uint16_t tracksCount){
+	std::vector<size_t> trackPositions;
+	// Skip the header, and any other chunk type without reading it.
+	size_t pos = 8 + read32(buffer, 4);
+	while(trackPositions.size() < tracksCount){
+		if(pos + 8 > buffer.size){
+			std::cerr << "[ERROR]: Missing track " << trackPositions.size() << "." << std::endl;
+			break;
 		}
-		_count += int(notes.size());
+		if(buffer[pos] == 'M' && buffer[pos+1] == 'T' && buffer[pos+2] == 'r' && buffer[pos+3] == 'k'){
+			trackPositions.push_back(pos);
+		} else {
+			std::cout << "[INFO]: Skipping unknown chunk " << std::string(buffer.data + pos, 4) << "." << std::endl;
+		}
+		pos += 8 + size_t(read32(buffer, pos + 4));
 	}
+	return trackPositions;
 }
 
 void MIDIFile::print() const {
+	// Raw events are discarded while loading, decode them again from the file.
+	MappedFile file;
+	if(file.open(_path) && file.buffer().size >= 14){
+		const MIDIBuffer buffer = file.buffer();
+		const std::vector<size_t> trackPositions = locateTracks(buffer, read16(buffer, 10));
+		for(size_t tid = 0; tid < trackPositions.size(); ++tid){
+			std::cout << "[INFO]: ---- Track " << tid << std::endl;
+			MIDITrack track;
+			track.readTrack(buffer, trackPositions[tid], true);
+			track.printEvents();
+		}
+	}
+
 	for(size_t tid = 0; tid < _tracks.size(); ++tid){
-		std::cout << "[INFO]: ---- Track " << tid << std::endl;
+		std::cout << "[INFO]: ---- Merged track " << tid << std::endl;
 		_tracks[tid].print();
 	}
 }
@@ -159,38 +196,206 @@ void MIDIFile::populateTemposAndSignature(){
 		}
 	}
 
-	// Merge all tempos.
-	std::map<size_t, MIDITempo> tempoChanges;
-	// Emplace default tempo, will be overwritten as soon as there is an initial tempo event.
-	tempoChanges[0] = MIDITempo(0, 500000);
-	for(const auto & tempo : mixedTempos){
-		tempoChanges[tempo.start] = tempo;
+	// Merge all tempos and compute their timestamps.
+	_tempoMap = TempoMap(mixedTempos, _unitsPerQuarterNote);
+}
+
+bool MIDIFile::loadCache(const std::string & cachePath, uint64_t sourceHash, uint64_t sourceSize, uint64_t options){
+	MappedFile file;
+	if(!file.open(cachePath)){
+		return false;
+	}
+	const MIDIBuffer buffer = file.buffer();
+	MIDICache::Header header;
+	if(buffer.size < sizeof(MIDICache::Header)){
+		return false;
+	}
+	std::memcpy(&header, buffer.data, sizeof(MIDICache::Header));
+	if(std::strncmp(header.magic, "MVCACHE", 8) != 0 || header.version != MIDICache::version || header.endianness != MIDICache::endianness){
+		return false;
+	}
+	// Stale cache.
+	if(header.sourceHash != sourceHash || header.sourceSize != sourceSize || header.options != options){
+		std::cout << "[INFO]: Cache is outdated, reloading." << std::endl;
+		return false;
+	}
+	const MIDICache::Layout layout(header.notesCount, header.pedalsCount, header.temposCount, header.namesSize);
+	if(header.totalSize != layout.totalSize || buffer.size != layout.totalSize || header.temposCount == 0){
+		return false;
+	}
+	// Names are null-terminated.
+	const char * namesData = reinterpret_cast<const char *>(buffer.data + layout.names);
+	const size_t namesSize = size_t(header.namesSize);
+	if(namesSize > 0 && namesData[namesSize - 1] != '\0'){
+		return false;
+	}
+	std::vector<std::string> names;
+	for(size_t pos = 0; pos < namesSize; pos += names.back().size() + 1){
+		names.emplace_back(namesData + pos);
+	}
+	if(names.size() != header.namesCount){
+		return false;
+	}
+
+	// Arrays are aligned in the file, copy each one in bulk to the note store.
+	const size_t notesCount = size_t(header.notesCount);
+	MIDINoteStore notes;
+	const double * starts = reinterpret_cast<const double *>(buffer.data + layout.notesStarts);
+	const double * ends = reinterpret_cast<const double *>(buffer.data + layout.notesEnds);
+	const uint32_t * tracks = reinterpret_cast<const uint32_t *>(buffer.data + layout.notesTracks);
+	const uint8_t * keys = reinterpret_cast<const uint8_t *>(buffer.data + layout.notesKeys);
+	const uint8_t * channels = reinterpret_cast<const uint8_t *>(buffer.data + layout.notesChannels);
+	const uint8_t * velocities = reinterpret_cast<const uint8_t *>(buffer.data + layout.notesVelocities);
+	notes.starts.assign(starts, starts + notesCount);
+	notes.ends.assign(ends, ends + notesCount);
+	notes.tracks.assign(tracks, tracks + notesCount);
+	notes.keys.assign(keys, keys + notesCount);
+	notes.channels.assign(channels, channels + notesCount);
+	notes.velocities.assign(velocities, velocities + notesCount);
+	const uint32_t * multiplicities = reinterpret_cast<const uint32_t *>(buffer.data + layout.notesMultiplicities);
+	notes.multiplicities.assign(multiplicities, multiplicities + notesCount);
+
+	const size_t pedalsCount = size_t(header.pedalsCount);
+	std::vector<MIDIPedal> pedals(pedalsCount);
+	const double * pedalsStarts = reinterpret_cast<const double *>(buffer.data + layout.pedalsStarts);
+	const double * pedalsDurations = reinterpret_cast<const double *>(buffer.data + layout.pedalsDurations);
+	const uint8_t * pedalsTypes = reinterpret_cast<const uint8_t *>(buffer.data + layout.pedalsTypes);
+	for(size_t pid = 0; pid < pedalsCount; ++pid){
+		pedals[pid] = MIDIPedal(PedalType(pedalsTypes[pid]), pedalsStarts[pid], pedalsDurations[pid]);
 	}
-	for(const auto & tempo : tempoChanges){
-		_tempos.push_back(tempo.second);
+
+	const size_t temposCount = size_t(header.temposCount);
+	std::vector<MIDITempo> tempos;
+	tempos.reserve(temposCount);
+	const uint64_t * temposStarts = reinterpret_cast<const uint64_t *>(buffer.data + layout.temposStarts);
+	const uint32_t * temposValues = reinterpret_cast<const uint32_t *>(buffer.data + layout.temposValues);
+	for(size_t tid = 0; tid < temposCount; ++tid){
+		tempos.emplace_back(size_t(temposStarts[tid]), temposValues[tid]);
+	}
+
+	_format = MIDIType(header.format);
+	_unitsPerFrame = uint16_t(header.unitsPerFrame);
+	_framesPerSeconds = header.framesPerSeconds;
+	_unitsPerQuarterNote = uint16_t(header.unitsPerQuarterNote);
+	_signature = header.signature;
+	_secondsPerMeasure = header.secondsPerMeasure;
+	_duration = header.duration;
+	_count = header.count;
+	_tempoMap = TempoMap(tempos, _unitsPerQuarterNote);
+	_tracks.resize(1);
+	_tracks[0].restore(std::move(notes), std::move(pedals), std::move(names));
+	_tracks[0].buildIndices();
+	return true;
+}
+
+bool MIDIFile::saveCache(const std::string & cachePath, uint64_t sourceHash, uint64_t sourceSize, uint64_t options) const {
+	if(_tracks.size() != 1){
+		return false;
+	}
+	const MIDINoteStore & notes = _tracks[0].noteStore();
+	const std::vector<MIDIPedal> & pedals = _tracks[0].pedals();
+
+	MIDICache::Header header;
+	std::memset(&header, 0, sizeof(MIDICache::Header));
+	std::strncpy(header.magic, "MVCACHE", 8);
+	header.version = MIDICache::version;
+	header.endianness = MIDICache::endianness;
+	header.sourceHash = sourceHash;
+	header.sourceSize = sourceSize;
+	header.options = options;
+	header.format = uint32_t(_format);
+	header.unitsPerFrame = _unitsPerFrame;
+	header.unitsPerQuarterNote = _unitsPerQuarterNote;
+	header.framesPerSeconds = _framesPerSeconds;
+	header.count = _count;
+	header.signature = _signature;
+	header.secondsPerMeasure = _secondsPerMeasure;
+	header.duration = _duration;
+	header.notesCount = notes.size();
+	header.pedalsCount = pedals.size();
+	header.temposCount = _tempoMap.size();
+	std::string names;
+	for(const auto & name : _tracks[0].sourceNames()){
+		// Names are written up to their first null character, as they are read back.
+		names += name.c_str();
+		names += '\0';
+	}
+	header.namesCount = _tracks[0].sourceNames().size();
+	header.namesSize = names.size();
+	const MIDICache::Layout layout(header.notesCount, header.pedalsCount, header.temposCount, header.namesSize);
+	header.totalSize = layout.totalSize;
+
+	std::vector<double> pedalsStarts, pedalsDurations;
+	std::vector<uint8_t> pedalsTypes;
+	for(const auto & pedal : pedals){
+		pedalsStarts.push_back(pedal.start);
+		pedalsDurations.push_back(pedal.duration);
+		pedalsTypes.push_back(uint8_t(pedal.type));
+	}
+	std::vector<uint64_t> temposStarts;
+	std::vector<uint32_t> temposValues;
+	for(size_t tid = 0; tid < _tempoMap.size(); ++tid){
+		temposStarts.push_back(_tempoMap[tid].start);
+		temposValues.push_back(_tempoMap[tid].tempo);
 	}
-	std::sort(_tempos.begin(), _tempos.end(), [](const MIDITempo& a, const MIDITempo& b){
-		return a.start < b.start;
-	});
 
-	// Compute the real time stamp of each tempo.
-	// We are guaranteed that there is an event at t = 0.
-	double currentTime = 0.0;
-	_tempos[0].timestamp = 0.0;
-	for(size_t tid = 1; tid < _tempos.size(); ++tid){
-		const int delta = int(_tempos[tid].start) - int(_tempos[tid-1].start);
-		currentTime += computeUnitsDuration(_tempos[tid-1].tempo, delta, _unitsPerQuarterNote);
-		_tempos[tid].timestamp = currentTime;
+	// Write to a temporary file first, so that an interrupted write never leaves a partial cache.
+	const std::string tempPath = cachePath + ".tmp";
+	std::ofstream output(widen(tempPath).c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!output.is_open()){
+		return false;
+	}
+	uint64_t position = 0;
+	const auto writeArray = [&output, &position](uint64_t offset, const void * data, uint64_t size){
+		// Pad up to the array position.
+		const char padding[8] = {0};
+		output.write(padding, std::streamsize(offset - position));
+		if(size > 0){
+			output.write(static_cast<const char *>(data), std::streamsize(size));
+		}
+		position = offset + size;
+	};
+	writeArray(0, &header, sizeof(MIDICache::Header));
+	writeArray(layout.notesStarts, notes.starts.data(), notes.size() * sizeof(double));
+	writeArray(layout.notesEnds, notes.ends.data(), notes.size() * sizeof(double));
+	writeArray(layout.notesTracks, notes.tracks.data(), notes.size() * sizeof(uint32_t));
+	writeArray(layout.notesMultiplicities, notes.multiplicities.data(), notes.size() * sizeof(uint32_t));
+	writeArray(layout.notesKeys, notes.keys.data(), notes.size());
+	writeArray(layout.notesChannels, notes.channels.data(), notes.size());
+	writeArray(layout.notesVelocities, notes.velocities.data(), notes.size());
+	writeArray(layout.pedalsStarts, pedalsStarts.data(), pedals.size() * sizeof(double));
+	writeArray(layout.pedalsDurations, pedalsDurations.data(), pedals.size() * sizeof(double));
+	writeArray(layout.pedalsTypes, pedalsTypes.data(), pedals.size());
+	writeArray(layout.temposStarts, temposStarts.data(), temposStarts.size() * sizeof(uint64_t));
+	writeArray(layout.temposValues, temposValues.data(), temposValues.size() * sizeof(uint32_t));
+	writeArray(layout.names, names.data(), names.size());
+	writeArray(layout.totalSize, nullptr, 0);
+	output.close();
+	if(!output){
+		removeFile(tempPath);
+		return false;
 	}
+	// Replace the previous cache if any.
+	if(!replaceFile(tempPath, cachePath)){
+		removeFile(tempPath);
+		return false;
+	}
+	return true;
 }
 
-void MIDIFile::mergeTracks(){
-	
-	for(size_t i = 1; i < _tracks.size(); ++i){
-		_tracks[0].merge(_tracks[i]);
+size_t MIDIFile::mergeTracks(std::vector<MIDITrack> & tracks, const LoadOptions & options){
+	MIDITrack::merge(tracks, options.threads);
+	tracks.resize(1);
+	if(!options.deduplicate){
+		return 0;
 	}
-	_tracks.resize(1);
-	
+	return tracks[0].removeDuplicates(double(options.duplicateTolerance));
+}
+
+void MIDIFile::buildIndices(std::vector<MIDITrack> & tracks, int threads){
+	parallelFor(tracks.size(), threads, [&tracks](size_t trackId){
+		tracks[trackId].buildIndices();
+	});
 }
 
 void MIDIFile::getNotes(std::vector<MIDINote> & notes, NoteType type, size_t track) const {
@@ -209,12 +414,19 @@ void MIDIFile::getNotesActive(ActiveNotesArray & actives, double time, size_t tr
 
 }
 
-void MIDIFile::getPedalsActive(bool & damper, bool &sostenuto, bool &soft, double time, size_t track) const {
-	_tracks[track].getPedalsActive(damper, sostenuto, soft, time);
+bool MIDIFile::getKeysRange(int & minKey, int & maxKey) const {
+	bool found = false;
+	for(const auto & track : _tracks){
+		int trackMin, trackMax;
+		if(track.getKeysRange(trackMin, trackMax)){
+			minKey = found ? (std::min)(minKey, trackMin) : trackMin;
+			maxKey = found ? (std::max)(maxKey, trackMax) : trackMax;
+			found = true;
+		}
+	}
+	return found;
 }
 
-void MIDIFile::updateSets(const SetOptions & options){
-	for(auto & track : _tracks){
-		track.updateSets(options);
-	}
+void MIDIFile::getPedalsActive(bool & damper, bool &sostenuto, bool &soft, double time, size_t track) const {
+	_tracks[track].getPedalsActive(damper, sostenuto, soft, time);
 }
@@ -4,6 +4,7 @@
 #include "MIDIUtils.h"
 #include "MIDIBase.h"
 #include "MIDITrack.h"
+#include "TempoMap.h"
 
 class MIDIFile {
 
@@ -11,9 +12,8 @@ public:
 	
 	MIDIFile();
 	
-	MIDIFile(const std::string & filePath);
-
-	void updateSets(const SetOptions & options);
+	/// Load a MIDI file. Progress (between 0 and 1) can be reported to a callback, possibly from several threads at once.
+	MIDIFile(const std::string & filePath, const LoadOptions & options = LoadOptions(), const std::function<void(float)> & progress = nullptr);
 
 	void print() const;
 
@@ -23,6 +23,9 @@ public:
 
 	void getPedalsActive(bool & damper, bool &sostenuto, bool &soft, double time, size_t track) const;
 
+	/// Smallest and largest keys played in the file, false if there are no notes.
+	bool getKeysRange(int & minKey, int & maxKey) const;
+
 	const double & signature() const { return _signature; }
 	
 	const double & secondsPerMeasure() const { return _secondsPerMeasure; }
@@ -31,11 +34,30 @@ public:
 
 	const int & notesCount() const { return _count; }
 
+	const TempoMap & tempoMap() const { return _tempoMap; }
+
+	const MIDITrack & track(size_t track) const { return _tracks[track]; }
+
+	size_t tracksCount() const { return _tracks.size(); }
+
+	/// Positions of the track chunks in a MIDI file content, other chunks are skipped.
+	static std::vector<size_t> locateTracks(const MIDIBuffer & buffer, uint16_t tracksCount);
+
+	/// Merge tracks with extracted notes in a single track, and collapse duplicates if requested. Returns the number of removed duplicates.
+	static size_t mergeTracks(std::vector<MIDITrack> & tracks, const LoadOptions & options);
+
+	/// Build the playback indices of merged tracks.
+	static void buildIndices(std::vector<MIDITrack> & tracks, int threads);
+
 private:
 
 	void populateTemposAndSignature();
 
-	void mergeTracks();
+	/// Load final notes, pedals and tempos from a binary cache, if it matches the source content and options. Arrays are copied out of the mapped cache.
+	bool loadCache(const std::string & cachePath, uint64_t sourceHash, uint64_t sourceSize, uint64_t options);
+
+	/// Save final notes, pedals and tempos to a binary cache.
+	bool saveCache(const std::string & cachePath, uint64_t sourceHash, uint64_t sourceSize, uint64_t options) const;
 
 	MIDIType _format = MIDIType::singleTrack;
 	uint16_t _unitsPerFrame = 1;
@@ -47,7 +69,9 @@ private:
 	int _count = 0;
 
 	std::vector<MIDITrack> _tracks;
-	std::vector<MIDITempo> _tempos;
+	TempoMap _tempoMap;
+
+	std::string _path;
 
 };
 
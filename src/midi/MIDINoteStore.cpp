@@ -0,0 +1,113 @@
+#include <algorithm>
+
+#include "MIDINoteStore.h"
+
+#if defined(__AVX__) || defined(__AVX2__)
+#include <immintrin.h>
+#define MIDI_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIDI_SIMD_SSE2
+#endif
+
+void MIDINoteStore::assign(const std::vector<MIDINote> & notes){
+	const size_t count = notes.size();
+	starts.resize(count);
+	ends.resize(count);
+	keys.resize(count);
+	channels.resize(count);
+	velocities.resize(count);
+	tracks.resize(count);
+	multiplicities.resize(count);
+	for(size_t i = 0; i < count; ++i){
+		const MIDINote & note = notes[i];
+		starts[i] = note.start;
+		ends[i] = note.start + note.duration;
+		keys[i] = uint8_t(note.note);
+		channels[i] = uint8_t(note.channel);
+		velocities[i] = uint8_t(note.velocity);
+		tracks[i] = note.track;
+		multiplicities[i] = note.multiplicity;
+	}
+}
+
+void MIDINoteStore::clear(){
+	starts.clear();
+	ends.clear();
+	keys.clear();
+	channels.clear();
+	velocities.clear();
+	tracks.clear();
+	multiplicities.clear();
+}
+
+MIDINote MIDINoteStore::note(size_t i) const {
+	MIDINote note(keys[i], starts[i], duration(i), velocities[i], channels[i], tracks[i]);
+	note.multiplicity = multiplicities[i];
+	return note;
+}
+
+void findOverlapping(const double * starts, const double * ends, size_t count, double windowStart, double windowEnd, std::vector<size_t> & hits){
+	size_t i = 0;
+#if defined(MIDI_SIMD_AVX)
+	const __m256d wStart = _mm256_set1_pd(windowStart);
+	const __m256d wEnd = _mm256_set1_pd(windowEnd);
+	for(; i + 4 <= count; i += 4){
+		const __m256d startBefore = _mm256_cmp_pd(_mm256_loadu_pd(starts + i), wEnd, _CMP_LE_OQ);
+		const __m256d endAfter = _mm256_cmp_pd(_mm256_loadu_pd(ends + i), wStart, _CMP_GE_OQ);
+		int mask = _mm256_movemask_pd(_mm256_and_pd(startBefore, endAfter));
+		while(mask != 0){
+			const int bit = mask & (-mask);
+			hits.push_back(i + (bit == 1 ? 0 : (bit == 2 ? 1 : (bit == 4 ? 2 : 3))));
+			mask &= mask - 1;
+		}
+	}
+#elif defined(MIDI_SIMD_SSE2)
+	const __m128d wStart = _mm_set1_pd(windowStart);
+	const __m128d wEnd = _mm_set1_pd(windowEnd);
+	for(; i + 2 <= count; i += 2){
+		const __m128d startBefore = _mm_cmple_pd(_mm_loadu_pd(starts + i), wEnd);
+		const __m128d endAfter = _mm_cmpge_pd(_mm_loadu_pd(ends + i), wStart);
+		const int mask = _mm_movemask_pd(_mm_and_pd(startBefore, endAfter));
+		if(mask & 1){
+			hits.push_back(i);
+		}
+		if(mask & 2){
+			hits.push_back(i + 1);
+		}
+	}
+#endif
+	for(; i < count; ++i){
+		if(starts[i] <= windowEnd && ends[i] >= windowStart){
+			hits.push_back(i);
+		}
+	}
+}
+
+void findKeysRange(const uint8_t * keys, size_t count, uint8_t & minKey, uint8_t & maxKey){
+	uint8_t minValue = 0xFF;
+	uint8_t maxValue = 0x0;
+	size_t i = 0;
+#if defined(MIDI_SIMD_AVX) || defined(MIDI_SIMD_SSE2)
+	if(count >= 16){
+		__m128i mins = _mm_set1_epi8(char(0xFF));
+		__m128i maxs = _mm_setzero_si128();
+		for(; i + 16 <= count; i += 16){
+			const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i));
+			mins = _mm_min_epu8(mins, values);
+			maxs = _mm_max_epu8(maxs, values);
+		}
+		uint8_t lanes[16];
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), mins);
+		minValue = *std::min_element(lanes, lanes + 16);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), maxs);
+		maxValue = *std::max_element(lanes, lanes + 16);
+	}
+#endif
+	for(; i < count; ++i){
+		minValue = (std::min)(minValue, keys[i]);
+		maxValue = (std::max)(maxValue, keys[i]);
+	}
+	minKey = minValue;
+	maxKey = maxValue;
+}
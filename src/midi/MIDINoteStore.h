@@ -0,0 +1,44 @@
+#ifndef MIDI_NOTE_STORE_H
+#define MIDI_NOTE_STORE_H
+
+#include "MIDIBase.h"
+
+/// Notes stored as one array per attribute, so that queries only load the attributes they need.
+struct MIDINoteStore {
+
+	void assign(const std::vector<MIDINote> & notes);
+
+	void clear();
+
+	size_t size() const { return starts.size(); }
+
+	bool empty() const { return starts.empty(); }
+
+	double duration(size_t i) const { return ends[i] - starts[i]; }
+
+	/// Rebuild a full note record.
+	MIDINote note(size_t i) const;
+
+	std::vector<double> starts;
+	std::vector<double> ends;
+	std::vector<uint8_t> keys;
+	std::vector<uint8_t> channels;
+	std::vector<uint8_t> velocities;
+	std::vector<uint32_t> tracks;
+	std::vector<uint32_t> multiplicities; ///< Number of duplicate notes collapsed in each note.
+};
+
+// Query kernels, vectorized when SSE2 or AVX are available.
+
+/// Append to hits the positions in [0, count) of the intervals overlapping the window [windowStart, windowEnd], bounds included.
+void findOverlapping(const double * starts, const double * ends, size_t count, double windowStart, double windowEnd, std::vector<size_t> & hits);
+
+/// Append to hits the positions in [0, count) of the intervals containing a given time, bounds included.
+inline void findActive(const double * starts, const double * ends, size_t count, double time, std::vector<size_t> & hits){
+	findOverlapping(starts, ends, count, time, time, hits);
+}
+
+/// Smallest and largest values of a non-empty list of keys.
+void findKeysRange(const uint8_t * keys, size_t count, uint8_t & minKey, uint8_t & maxKey);
+
+#endif // MIDI_NOTE_STORE_H
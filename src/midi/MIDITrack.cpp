@@ -1,14 +1,90 @@
-#include <tuple>
 #include <cmath>
 #include <algorithm>
+#include <limits>
+#include <thread>
+#include <unordered_map>
 #include "MIDITrack.h"
 
+/// Decoded status bytes, so that events are dispatched with a single lookup.
+#define STATUS_ROW(base) \
+	MIDIStatus::decode(base + 0x0), MIDIStatus::decode(base + 0x1), MIDIStatus::decode(base + 0x2), MIDIStatus::decode(base + 0x3), \
+	MIDIStatus::decode(base + 0x4), MIDIStatus::decode(base + 0x5), MIDIStatus::decode(base + 0x6), MIDIStatus::decode(base + 0x7), \
+	MIDIStatus::decode(base + 0x8), MIDIStatus::decode(base + 0x9), MIDIStatus::decode(base + 0xA), MIDIStatus::decode(base + 0xB), \
+	MIDIStatus::decode(base + 0xC), MIDIStatus::decode(base + 0xD), MIDIStatus::decode(base + 0xE), MIDIStatus::decode(base + 0xF)
 
-size_t MIDITrack::readTrack(const std::vector<char>& buffer, size_t pos){
+static constexpr MIDIStatus statusTable[256] = {
+	STATUS_ROW(0x00), STATUS_ROW(0x10), STATUS_ROW(0x20), STATUS_ROW(0x30),
+	STATUS_ROW(0x40), STATUS_ROW(0x50), STATUS_ROW(0x60), STATUS_ROW(0x70),
+	STATUS_ROW(0x80), STATUS_ROW(0x90), STATUS_ROW(0xA0), STATUS_ROW(0xB0),
+	STATUS_ROW(0xC0), STATUS_ROW(0xD0), STATUS_ROW(0xE0), STATUS_ROW(0xF0)
+};
+
+#undef STATUS_ROW
+
+/// Notes currently held while reading a track, in a flat table indexed by channel and key.
+/// Each slot is a small queue, only used as such when overlapping notes are stacked.
+class OpenNotesTable {
+public:
+
+	struct OpenNote {
+		size_t start;
+		uint8_t velocity;
+	};
+
+	OpenNotesTable(NotePairing pairing) : _slots(16 * 128), _pairing(pairing) {}
+
+	/// Start a note. When retriggering, the note previously held on the slot is ended and returned.
+	bool open(uint8_t channel, uint8_t key, size_t start, uint8_t velocity, OpenNote & ended){
+		Slot & slot = _slots[index(channel, key)];
+		const bool hasEnded = _pairing == NotePairing::RETRIGGER && pop(slot, ended);
+		slot.notes.push_back({start, velocity});
+		return hasEnded;
+	}
+
+	/// End a note held on the slot, if any, following the pairing policy.
+	bool close(uint8_t channel, uint8_t key, OpenNote & ended){
+		return pop(_slots[index(channel, key)], ended);
+	}
+
+private:
+
+	struct Slot {
+		std::vector<OpenNote> notes;
+		size_t head = 0; ///< First note still held, for FIFO pairing.
+	};
+
+	static size_t index(uint8_t channel, uint8_t key){
+		return size_t(channel & 0xF) * 128 + size_t(key & 0x7F);
+	}
+
+	bool pop(Slot & slot, OpenNote & ended){
+		if(slot.head >= slot.notes.size()){
+			return false;
+		}
+		if(_pairing == NotePairing::FIFO){
+			ended = slot.notes[slot.head++];
+		} else {
+			ended = slot.notes.back();
+			slot.notes.pop_back();
+		}
+		// Rewind once the slot is empty, to reuse its storage.
+		if(slot.head == slot.notes.size()){
+			slot.notes.clear();
+			slot.head = 0;
+		}
+		return true;
+	}
+
+	std::vector<Slot> _slots;
+	const NotePairing _pairing;
+};
+
+
+size_t MIDITrack::readTrack(const MIDIBuffer & buffer, size_t pos, bool keepEvents, NotePairing pairing){
 	const size_t backupPos = pos;
 	
 	//Check header
-	if( !(buffer[pos] == 'M' && buffer[pos+1] == 'T' && buffer[pos+2] == 'r' && buffer[pos+3] == 'k')){
+	if(pos + 8 > buffer.size || !(buffer[pos] == 'M' && buffer[pos+1] == 'T' && buffer[pos+2] == 'r' && buffer[pos+3] == 'k')){
 		std::cerr << "[ERROR]: Missing track." << std::endl;
 		return 3;
 	}
@@ -20,197 +96,378 @@ size_t MIDITrack::readTrack(const std::vector<char>& buffer, size_t pos){
 		std::cerr << "[ERROR]: Empty track." << std::endl;
 		return 3;
 	}
+	_length = length;
 
-	while(pos < backupPos + 8 + length){
-		
-		size_t delta = readVarLen(buffer,pos);
-		uint8_t eventMetaType = read8(buffer, pos);
+	// Don't read past the end of truncated files.
+	const size_t endPos = (std::min)(backupPos + 8 + length, buffer.size);
+	if(keepEvents){
+		// Most events take a few bytes, avoid reallocations on large tracks.
+		_events.reserve((endPos - pos) / 4);
+		_source = buffer;
+	}
+
+	// Everything is extracted in a single pass, events are discarded as we go unless requested.
+	// Keep track of active notes and pedals.
+	OpenNotesTable currentNotes(pairing);
+	// Start time of each pedal type, if pressed.
+	std::array<bool, 3> pedalsOn = {{false, false, false}};
+	std::array<size_t, 3> pedalsStart = {{0, 0, 0}};
+
+	size_t timeInUnits = 0;
+	// Status of the last channel event, for running status.
+	uint8_t runningStatus = 0;
+	// Is a sysex split in several packets in progress.
+	bool sysexOpen = false;
+
+	while(pos < endPos){
 		
-		if(eventMetaType == 0xFF){
-			_events.push_back(MIDIEvent::readMetaEvent(buffer,pos, delta));
-		} else if (eventMetaType >= 0xF0 && eventMetaType <= 0xF7){
-			_events.push_back(MIDIEvent::readSysexEvent(buffer, pos, delta));
-		}  else {
-			_events.push_back(MIDIEvent::readMIDIEvent(buffer, pos, delta, _previousEventFirstByte));
+		const uint32_t delta = uint32_t(readVarLen(buffer, pos, endPos));
+		timeInUnits += delta;
+		if(pos >= endPos){
+			break;
 		}
-	}
 
-	// Scan events for track info.
-	// Could do it while creating events, but let's separate tasks, shall we?
-	bool minorKey = false;
-	short keyShift = 0;
+		uint8_t status = read8(buffer, pos);
+		MIDIStatus info = statusTable[status];
+		if(info.kind == MIDIStatus::DATA){
+			// Running status: the byte is already data, reuse the previous channel status.
+			if(runningStatus == 0){
+				std::cerr << "[WARN]: Missing status byte, ignoring the end of the track." << std::endl;
+				break;
+			}
+			status = runningStatus;
+			info = statusTable[status];
+		} else {
+			++pos;
+		}
+
+		MIDIEvent event;
+		if((info.kind == MIDIStatus::META || info.kind == MIDIStatus::SYSEX) && pos >= endPos){
+			break;
+		}
+		if(info.kind == MIDIStatus::META){
+			event = MIDIEvent::readMetaEvent(buffer, pos, endPos, delta);
+		} else if(info.kind == MIDIStatus::SYSEX){
+			event = MIDIEvent::readSysexEvent(buffer, pos, endPos, delta, status, sysexOpen);
+		} else {
+			if(pos + info.length > endPos){
+				break;
+			}
+			if(status < 0xF0){
+				runningStatus = status;
+			}
+			// Skip unused messages directly.
+			if(info.kind == MIDIStatus::SKIPPED && !keepEvents){
+				pos += info.length;
+				continue;
+			}
+			event = MIDIEvent::readMIDIEvent(buffer, pos, delta, status, info.length);
+			pos += info.length;
+		}
 
-	for(auto& event : _events){
 		if(event.category == EventCategory::META){
-			if(event.type == sequenceName){
-				std::string tempName = "";
-				for(size_t i = 0; i < event.data.size(); ++i){
-					tempName += char(event.data[i]);
-				}
-				_name = tempName;
-			} else if(event.type == instrumentName){
-				std::string tempName = "";
-				for(size_t i = 0; i < event.data.size(); ++i){
-					tempName += char(event.data[i]);
+			readMetaInfos(buffer, event, timeInUnits);
+
+		} else if(info.kind == MIDIStatus::NOTE){
+			const uint8_t channel = event.data[0];
+			const uint8_t noteInd = event.data[1];
+			const bool shouldNew = event.type == noteOn && event.data[2] > 0;
+			OpenNotesTable::OpenNote ended;
+			const bool hasEnded = shouldNew
+				? currentNotes.open(channel, noteInd, timeInUnits, event.data[2], ended)
+				: currentNotes.close(channel, noteInd, ended);
+			if(hasEnded){
+				// Finish it, timings will be computed once all tempos are known.
+				_notes.emplace_back(noteInd, 0.0, 0.0, ended.velocity, channel, 0);
+				_notesUnits.emplace_back(ended.start, timeInUnits);
+			}
+		} else if(info.kind == MIDIStatus::CONTROLLER){
+			const int rawType = event.data[1];
+			// Handle only pedal changes.
+			if(rawType == 64 || rawType == 66 || rawType == 67){
+				const PedalType type = rawType == 64 ? PedalType::DAMPER : (rawType == 66 ? PedalType::SOSTENUTO : PedalType::SOFT);
+				const size_t pedalInd = size_t(type);
+				const bool shouldStart = event.data[2] >= 64;
+				// Check if the pedal was on before and we should now stop it.
+				if(pedalsOn[pedalInd] && !shouldStart){
+					// Finish the pedal.
+					_pedals.emplace_back(type, 0.0, 0.0);
+					_pedalsUnits.emplace_back(pedalsStart[pedalInd], timeInUnits);
+					pedalsOn[pedalInd] = false;
+				} else if(!pedalsOn[pedalInd] && shouldStart){
+					pedalsStart[pedalInd] = timeInUnits;
+					pedalsOn[pedalInd] = true;
 				}
-				_instrument = tempName;
-			} else if (event.type == keySignature){
-				keyShift = event.data[0];
-				minorKey = (event.data[1] > 0);
 			}
 		}
+
+		if(keepEvents){
+			_events.push_back(event);
+		}
 	}
-	
-	std::cout << "[INFO]: Track " << _name << " (length: " << length << ", instrument: " << _instrument <<", " << (minorKey ? "minor": "major") << ")." << std::endl;
+	_events.shrink_to_fit();
 	
 	return backupPos + 8 + length;
 }
 
+void MIDITrack::readMetaInfos(const MIDIBuffer & buffer, const MIDIEvent & event, size_t timeInUnits){
+	// Only read the payload of the few events used.
+	const uint8_t * data = reinterpret_cast<const uint8_t *>(buffer.data + event.offset);
+	if(event.type == sequenceName){
+		_name = std::string(reinterpret_cast<const char *>(data), event.length);
+	} else if(event.type == instrumentName){
+		_instrument = std::string(reinterpret_cast<const char *>(data), event.length);
+	} else if(event.type == keySignature && event.length >= 2){
+		_minorKey = (data[1] > 0);
+	} else if(event.type == setTempo && event.length >= 3){
+		const unsigned int tempo = (data[0] << 16) | (data[1] << 8) | data[2];
+		if(tempo == 0){
+			std::cerr << "[WARN]: Ignoring null tempo." << std::endl;
+		} else {
+			_tempos.emplace_back(timeInUnits, tempo);
+		}
+	} else if(event.type == timeSignature && event.length >= 2){
+		_signature = double(data[0]) / double(std::pow(2,data[1]));
+	}
+}
+
+void MIDITrack::printSummary() const {
+	std::cout << "[INFO]: Track " << _name << " (length: " << _length << ", instrument: " << _instrument <<", " << (_minorKey ? "minor": "major") << ")." << std::endl;
+}
+
 double MIDITrack::extractTempos(std::vector<MIDITempo> & tempos) const {
-	size_t timeInUnits = 0;
-	double signature = 4.0/4.0;
-	for(auto& event : _events){
-		timeInUnits += (event.delta);
-		if(event.category == EventCategory::META && event.type == setTempo){
-			const unsigned int tempo = ((event.data[0] & 0xFF) << 16) | ((event.data[1] & 0xFF) << 8) | (event.data[2] & 0xFF);
-			tempos.emplace_back(timeInUnits, tempo);
+	tempos.insert(tempos.end(), _tempos.begin(), _tempos.end());
+	return _signature;
+}
 
-		} else if(event.category == EventCategory::META && event.type == timeSignature){
-			signature = double(event.data[0]) / double(std::pow(2,event.data[1]));
+void MIDITrack::extractNotes(const TempoMap & tempos, unsigned int trackId){
+	// Notes and pedals are emitted when they end, so end positions are already sorted and can be converted in one sweep.
+	// Start positions are almost sorted, use a cursor.
+	std::vector<size_t> ends(_notesUnits.size());
+	for(size_t nid = 0; nid < _notesUnits.size(); ++nid){
+		ends[nid] = _notesUnits[nid].second;
+	}
+	std::vector<double> endTimes;
+	tempos.seconds(ends, endTimes);
+	TempoMap::Cursor cursor(tempos);
+	for(size_t nid = 0; nid < _notes.size(); ++nid){
+		auto & note = _notes[nid];
+		note.start = cursor.seconds(_notesUnits[nid].first);
+		note.duration = endTimes[nid] - note.start;
+		note.track = trackId;
+	}
 
-		}
+	TempoMap::Cursor pedalCursor(tempos);
+	for(size_t pid = 0; pid < _pedals.size(); ++pid){
+		_pedals[pid].start = pedalCursor.seconds(_pedalsUnits[pid].first);
+		_pedals[pid].duration = tempos.seconds(_pedalsUnits[pid].second) - _pedals[pid].start;
 	}
-	return signature;
-}
+	// Order by start time, the track is usually almost sorted already.
+	std::stable_sort(_notes.begin(), _notes.end(), [](const MIDINote & a, const MIDINote & b) { return a.start < b.start; });
+	std::stable_sort(_pedals.begin(), _pedals.end(), [](const MIDIPedal & a, const MIDIPedal & b) { return a.start < b.start; });
 
-void MIDITrack::extractNotes(const std::vector<MIDITempo> & tempos, uint16_t unitsPerQuarterNote, unsigned int trackId){
-	// Scan events, focusing on the note ON/OFF events.
-	// Keep track of active notes.
-	std::map<short, std::tuple<size_t, short, short>> currentNotes;
-	std::map<PedalType, size_t> currentPedals;
+	// Units are not needed anymore.
+	std::vector<std::pair<size_t, size_t>>().swap(_notesUnits);
+	std::vector<std::pair<size_t, size_t>>().swap(_pedalsUnits);
+}
 
-	size_t timeInUnits = 0;
+void MIDITrack::getNotes(std::vector<MIDINote> & notes, NoteType type) const {
+	notes.clear();
 
-	for(auto& event : _events){
-		timeInUnits += (event.delta);
-		if(event.category != EventCategory::MIDI){
-			continue;
+	for(size_t i = 0; i < _store.size(); ++i){
+		const uint8_t key = _store.keys[i];
+		const bool isMin = noteIsMinor[key % 12];
+		const short shiftId = (key/12) * 7 + noteShift[key % 12];
+		if(type == NoteType::ALL || (type == NoteType::MINOR && isMin) || (type == NoteType::MAJOR && !isMin)){
+			notes.push_back(_store.note(i));
+			notes.back().note = shiftId;
 		}
+	}
 
-		// Handle notes.
-		if(event.type == noteOn || event.type == noteOff){
-			const size_t noteInd = event.data[1];
-			if(currentNotes.count(noteInd) > 0){
-				// The current note is already present.
-				const auto & noteTuple = currentNotes[noteInd];
-				// Finish it.
-				const size_t start = std::get<0>(noteTuple);
-				const size_t end = timeInUnits;
-				// Create the final note with timing.
-				// Look for the start and end timestamps using the tempos and their timestamps.
-
-				const auto times = computeNoteTimings(tempos, start, end, unitsPerQuarterNote);
-
-				const short velocity = std::get<1>(noteTuple);
-				const short channel = std::get<2>(noteTuple);
-				_notes.emplace_back(noteInd, times.first, times.second - times.first, velocity, channel, trackId);
-
-				// Remove note.
-				currentNotes.erase(noteInd);
-			}
+}
 
-			// Check if we have to start a new note.
-			const bool shouldNew = event.type == noteOn && event.data[2] > 0;
-			if(shouldNew){
-				currentNotes[noteInd] = std::make_tuple(timeInUnits, event.data[2], event.data[0]);
-			}
-		} else if(event.type == controllerChange){
-			const int rawType = event.data[1];
-			// Handle only pedal changes.
-			if(rawType != 64 && rawType != 66 && rawType != 67){
+size_t MIDITrack::removeDuplicates(double tolerance){
+	// Last kept note for each source track and key.
+	std::unordered_map<uint64_t, size_t> lastNotes;
+	size_t kept = 0;
+	for(size_t nid = 0; nid < _notes.size(); ++nid){
+		const MIDINote & note = _notes[nid];
+		const uint64_t slot = (uint64_t(note.track) << 7) | (uint64_t(note.note) & 127);
+		const auto last = lastNotes.find(slot);
+		if(last != lastNotes.end()){
+			MIDINote & previous = _notes[last->second];
+			const double previousEnd = previous.start + previous.duration;
+			// Notes are sorted by start, only the ends have to be compared both ways.
+			if(note.start - previous.start <= tolerance && std::abs(note.start + note.duration - previousEnd) <= tolerance){
+				previous.velocity = (std::max)(previous.velocity, note.velocity);
+				previous.multiplicity += note.multiplicity;
 				continue;
 			}
-			const PedalType type = rawType == 64 ? PedalType::DAMPER : (rawType == 66 ? PedalType::SOSTENUTO : PedalType::SOFT);
-			const bool shouldStart = event.data[2] >= 64;
-			const bool isOn = currentPedals.count(type) > 0;
-			// Check if the pedal was on before and we should now stop it.
-			if(isOn && !shouldStart){
-				// Finish the pedal.
-				const size_t start = currentPedals[type];
-				const size_t end = timeInUnits;
-				// Create the final pedal with timing.
-				// Look for the start and end timestamps using the tempos and their timestamps.
-				const auto times = computeNoteTimings(tempos, start, end, unitsPerQuarterNote);
-				_pedals.emplace_back(type, times.first, times.second - times.first);
-				// Remove pedal.
-				currentPedals.erase(type);
-			} else if(!isOn && shouldStart){
-				currentPedals[type] = timeInUnits;
-			}
 		}
+		lastNotes[slot] = kept;
+		_notes[kept++] = note;
 	}
+	const size_t removed = _notes.size() - kept;
+	_notes.resize(kept);
+	return removed;
 }
 
-void MIDITrack::getNotes(std::vector<MIDINote> & notes, NoteType type) const {
-	notes.clear();
+void MIDITrack::buildIndices(){
+	// Notes are final, move them to the column store.
+	if(!_notes.empty()){
+		_store.assign(_notes);
+		std::vector<MIDINote>().swap(_notes);
+	}
 
-	for(auto& note : _notes){
-		const bool isMin = noteIsMinor[note.note % 12];
-		const short shiftId = (note.note/12) * 7 + noteShift[note.note % 12];
-		if(type == NoteType::ALL || (type == NoteType::MINOR && isMin) || (type == NoteType::MAJOR && !isMin)){
-			notes.push_back(note);
-			notes.back().note = shiftId;
+	// Group notes by duration class, a note active at time t then starts in [t - max duration, t] in its bucket.
+	// Notes are sorted by start time, and so is each bucket.
+	std::map<int, DurationBucket> buckets;
+	for(size_t i = 0; i < _store.size(); ++i){
+		const double duration = _store.duration(i);
+		int durationClass = 0;
+		std::frexp(duration, &durationClass);
+		DurationBucket & bucket = buckets[durationClass];
+		bucket.ids.push_back(i);
+		bucket.starts.push_back(_store.starts[i]);
+		bucket.ends.push_back(_store.ends[i]);
+		bucket.maxDuration = (std::max)(bucket.maxDuration, duration);
+	}
+	_activeIndex.clear();
+	for(auto & bucket : buckets){
+		DurationBucket & dst = bucket.second;
+		// Durations are recomputed from rounded bounds, add some margin as the bucket range is only used to skip notes.
+		dst.maxDuration = dst.maxDuration * (1.0 + 1e-9) + 1e-9;
+		_activeIndex.push_back(std::move(dst));
+	}
+
+	// Group notes by source track, keeping them sorted by start time in each group. Trailing tracks without notes are kept.
+	uint32_t tracksCount = uint32_t(_sourceNames.size());
+	for(const uint32_t track : _store.tracks){
+		tracksCount = (std::max)(tracksCount, track + 1);
+	}
+	_tracksRanges.assign(tracksCount + 1, 0);
+	for(const uint32_t track : _store.tracks){
+		++_tracksRanges[track + 1];
+	}
+	for(size_t tid = 0; tid < tracksCount; ++tid){
+		_tracksRanges[tid + 1] += _tracksRanges[tid];
+	}
+	_notesByTrack.resize(_store.size());
+	std::vector<size_t> offsets(_tracksRanges.begin(), _tracksRanges.end() - 1);
+	for(size_t i = 0; i < _store.size(); ++i){
+		_notesByTrack[offsets[_store.tracks[i]]++] = i;
+	}
+
+	// Merge overlapping pedal intervals of each type, pedals are sorted by start time.
+	for(auto & edges : _pedalEdges){
+		edges.clear();
+	}
+	for(const auto & pedal : _pedals){
+		auto & edges = _pedalEdges[int(pedal.type)];
+		const double end = pedal.start + pedal.duration;
+		if(!edges.empty() && pedal.start <= edges.back()){
+			edges.back() = (std::max)(edges.back(), end);
+		} else {
+			edges.push_back(pedal.start);
+			edges.push_back(end);
 		}
 	}
+}
 
+void MIDITrack::getNotesActive(std::vector<size_t> & ids, double time) const {
+	ids.clear();
+	std::vector<size_t> hits;
+	for(const auto & bucket : _activeIndex){
+		// Skip notes that have ended before the time, even with the longest duration of the bucket,
+		// and notes starting after it.
+		const double maxDuration = bucket.maxDuration;
+		const size_t first = size_t(std::lower_bound(bucket.starts.begin(), bucket.starts.end(), time, [maxDuration](double start, double t){
+			return start + maxDuration < t;
+		}) - bucket.starts.begin());
+		const size_t last = size_t(std::upper_bound(bucket.starts.begin() + first, bucket.starts.end(), time) - bucket.starts.begin());
+		hits.clear();
+		findActive(bucket.starts.data() + first, bucket.ends.data() + first, last - first, time, hits);
+		for(const size_t hit : hits){
+			ids.push_back(bucket.ids[first + hit]);
+		}
+	}
 }
 
 void MIDITrack::getNotesActive(ActiveNotesArray & actives, double time) const {
+	getNotesActive(actives, time, std::vector<bool>());
+}
+
+void MIDITrack::getNotesActive(ActiveNotesArray & actives, double time, const std::vector<bool> & tracksEnabled) const {
 	// Reset all notes.
 	for(int i = 0; i < int(actives.size()); ++i){
 		 actives[i].enabled = false;
 	}
-	const size_t count = _notes.size();
-	for(size_t i = 0; i < count; ++i){
-		auto& note = _notes[i];
-		if(note.start <= time && note.start+note.duration >= time){
-			actives[note.note].enabled = true;
-			actives[note.note].duration = float(note.duration);
-			actives[note.note].start = float(note.start);
-			actives[note.note].set = note.set;
+	std::vector<size_t> ids;
+	getNotesActive(ids, time);
+	// For overlapping notes on a key, keep the last one in the track.
+	const size_t none = std::numeric_limits<size_t>::max();
+	std::array<size_t, 128> winners;
+	winners.fill(none);
+	for(const size_t id : ids){
+		if(!isTrackEnabled(tracksEnabled, _store.tracks[id])){
+			continue;
+		}
+		const uint8_t key = _store.keys[id];
+		if(winners[key] == none || winners[key] < id){
+			winners[key] = id;
 		}
 	}
+	for(size_t key = 0; key < winners.size(); ++key){
+		if(winners[key] == none){
+			continue;
+		}
+		const size_t id = winners[key];
+		actives[key].enabled = true;
+		actives[key].duration = float(_store.duration(id));
+		actives[key].start = float(_store.starts[id]);
+		actives[key].channel = _store.channels[id];
+		actives[key].track = _store.tracks[id];
+	}
+}
+
+void MIDITrack::getTrackNotes(size_t track, const size_t * & ids, size_t & count) const {
+	if(track >= sourceTracksCount()){
+		ids = nullptr;
+		count = 0;
+		return;
+	}
+	ids = _notesByTrack.data() + _tracksRanges[track];
+	count = _tracksRanges[track + 1] - _tracksRanges[track];
 }
 
 void MIDITrack::getPedalsActive(bool & damper, bool &sostenuto, bool &soft, double time) const {
-	damper = sostenuto = soft = false;
-	const size_t count = _pedals.size();
-	for(size_t i = 0; i < count; ++i){
-		auto& pedal = _pedals[i];
-		if(pedal.start <= time && pedal.start+pedal.duration >= time){
-			if(pedal.type == PedalType::DAMPER){
-				damper = true;
-			} else if(pedal.type == PedalType::SOSTENUTO){
-				sostenuto = true;
-			} else if(pedal.type == PedalType::SOFT){
-				soft = true;
-			}
-			// Early exit (rare).
-			if(damper && sostenuto && soft){
-				break;
-			}
-		}
+	damper = isPedalActive(PedalType::DAMPER, time);
+	sostenuto = isPedalActive(PedalType::SOSTENUTO, time);
+	soft = isPedalActive(PedalType::SOFT, time);
+}
+
+bool MIDITrack::getKeysRange(int & minKey, int & maxKey) const {
+	if(_store.empty()){
+		return false;
 	}
+	uint8_t minValue, maxValue;
+	findKeysRange(_store.keys.data(), _store.size(), minValue, maxValue);
+	minKey = int(minValue);
+	maxKey = int(maxValue);
+	return true;
+}
+
+bool MIDITrack::isPedalActive(PedalType type, double time) const {
+	const auto & edges = _pedalEdges[int(type)];
+	// An odd number of edges before the time means the pedal is pressed, releases are inclusive.
+	const size_t count = size_t(std::upper_bound(edges.begin(), edges.end(), time) - edges.begin());
+	return (count % 2 == 1) || (count > 0 && edges[count - 1] == time);
 }
 
 void MIDITrack::print() const {
-	std::cout << "[INFO]: * Events (" << _events.size() << "): " << std::endl;
-	for(auto& event : _events){
-		event.print();
-	}
-	std::cout << "[INFO]: * Notes (" << _notes.size() << "): " << std::endl;
-	for(auto& note : _notes){
-		note.print();
+	std::cout << "[INFO]: * Notes (" << _store.size() << "): " << std::endl;
+	for(size_t i = 0; i < _store.size(); ++i){
+		_store.note(i).print();
 	}
 
 	std::cout << "[INFO]: * Pedals (" << _pedals.size() << "): " << std::endl;
@@ -219,55 +476,124 @@ void MIDITrack::print() const {
 	}
 }
 
-void MIDITrack::merge(MIDITrack & other){
-	for(auto& note : other._notes){
-		_notes.push_back(note);
+void MIDITrack::printEvents() const {
+	std::cout << "[INFO]: * Events (" << _events.size() << "): " << std::endl;
+	for(auto& event : _events){
+		event.print(event.category == EventCategory::MIDI ? nullptr : payload(event));
 	}
-	std::sort(_notes.begin(), _notes.end(), [](const MIDINote & a, const MIDINote & b) { return(a.start < b.start); } );
+}
 
-	for(auto& pedal : other._pedals){
-		_pedals.push_back(pedal);
+/// Merge lists sorted by start time with a k-way merge, writing to the output starting at the given index.
+/// Ties are broken by list index, so the result is deterministic.
+template<typename T>
+static void mergeSorted(const std::vector<const std::vector<T> *> & lists, const std::vector<size_t> & begins, const std::vector<size_t> & ends, std::vector<T> & output, size_t outputIndex){
+	// Min-heap of (list, position) pairs, on the current element of each list.
+	std::vector<std::pair<size_t, size_t>> heads;
+	heads.reserve(lists.size());
+	for(size_t lid = 0; lid < lists.size(); ++lid){
+		if(begins[lid] < ends[lid]){
+			heads.emplace_back(lid, begins[lid]);
+		}
+	}
+	const auto comp = [&lists](const std::pair<size_t, size_t> & a, const std::pair<size_t, size_t> & b){
+		const double startA = (*lists[a.first])[a.second].start;
+		const double startB = (*lists[b.first])[b.second].start;
+		return startA > startB || (startA == startB && a.first > b.first);
+	};
+	std::make_heap(heads.begin(), heads.end(), comp);
+	while(!heads.empty()){
+		std::pop_heap(heads.begin(), heads.end(), comp);
+		auto & head = heads.back();
+		output[outputIndex++] = (*lists[head.first])[head.second];
+		++head.second;
+		if(head.second < ends[head.first]){
+			std::push_heap(heads.begin(), heads.end(), comp);
+		} else {
+			heads.pop_back();
+		}
 	}
-	std::sort(_pedals.begin(), _pedals.end(), [](const MIDIPedal & a, const MIDIPedal & b) { return(a.start < b.start); } );
 }
 
-std::pair<double, double> MIDITrack::computeNoteTimings(const std::vector<MIDITempo> & tempos, size_t start,size_t end, uint16_t upqn) const {
-	double startTime;
-	double endTime;
+/// Merge lists sorted by start time into a single allocation. The timeline can be split in chunks processed in parallel.
+template<typename T>
+static void mergeSorted(const std::vector<const std::vector<T> *> & lists, std::vector<T> & output, int threads){
+	size_t total = 0;
+	for(const auto * list : lists){
+		total += list->size();
+	}
+	output.resize(total);
+	if(total == 0){
+		return;
+	}
 
-	size_t tid = 0;
-	for(; tid < tempos.size(); ++tid){
-		if((tid == tempos.size() - 1) || (tempos[tid+1].start > start)){
-			// The note started before tid+1, we should use the previous one.
-			startTime = tempos[tid].timestamp + computeUnitsDuration(tempos[tid].tempo, start - tempos[tid].start, upqn);
-			break;
+	// Pick split times evenly among a sample of all start times.
+	const size_t chunkSize = 1 << 16;
+	const size_t workers = threads > 0 ? size_t(threads) : size_t((std::max)(std::thread::hardware_concurrency(), 1u));
+	const size_t chunksCount = (std::min)(workers, (total + chunkSize - 1) / chunkSize);
+	std::vector<double> splits;
+	if(chunksCount > 1){
+		std::vector<double> samples;
+		const size_t stride = (std::max)(total / (chunksCount * 64), size_t(1));
+		for(const auto * list : lists){
+			for(size_t i = 0; i < list->size(); i += stride){
+				samples.push_back((*list)[i].start);
+			}
 		}
-	}
-	// Start from the same one again.
-	for(; tid < tempos.size(); ++tid){
-		if((tid == tempos.size() - 1) || (tempos[tid+1].start > end)){
-			// The note ended before tid+1, we should use the previous one.
-			endTime = tempos[tid].timestamp + computeUnitsDuration(tempos[tid].tempo, end - tempos[tid].start, upqn);
-			break;
+		std::sort(samples.begin(), samples.end());
+		for(size_t cid = 1; cid < chunksCount; ++cid){
+			splits.push_back(samples[cid * samples.size() / chunksCount]);
 		}
 	}
+	splits.push_back(std::numeric_limits<double>::infinity());
 
-	startTime /= 1000000.0;
-	endTime /= 1000000.0;
-
-	return std::make_pair(startTime, endTime);
+	// For each chunk, find the range of each list it covers, and where its output starts.
+	const auto startBefore = [](const T & item, double time){ return item.start < time; };
+	std::vector<std::vector<size_t>> bounds(splits.size() + 1, std::vector<size_t>(lists.size(), 0));
+	std::vector<size_t> offsets(splits.size() + 1, 0);
+	for(size_t cid = 0; cid < splits.size(); ++cid){
+		for(size_t lid = 0; lid < lists.size(); ++lid){
+			const auto & list = *lists[lid];
+			const size_t bound = size_t(std::lower_bound(list.begin(), list.end(), splits[cid], startBefore) - list.begin());
+			bounds[cid + 1][lid] = (cid + 1 == splits.size()) ? list.size() : bound;
+			offsets[cid + 1] += bounds[cid + 1][lid];
+		}
+	}
+	parallelFor(splits.size(), threads, [&](size_t cid){
+		mergeSorted(lists, bounds[cid], bounds[cid + 1], output, offsets[cid]);
+	});
 }
 
-void MIDITrack::updateSets(const SetOptions & options){
-	for(auto & note : _notes){
-		if(options.mode == SetMode::CHANNEL){
-			note.set = int(note.channel);
-		} else if(options.mode == SetMode::TRACK){
-			note.set = int(note.track);
-		} else if(options.mode == SetMode::KEY){
-			note.set = note.note < options.key ? 0 : 1;
-		} else {
-			note.set = 0;
-		}
+void MIDITrack::merge(std::vector<MIDITrack> & tracks, int threads){
+	if(tracks.empty()){
+		return;
+	}
+	// Keep all names, tracks without notes can still be listed.
+	std::vector<std::string> names;
+	for(const auto & track : tracks){
+		names.push_back(track._name);
 	}
+	tracks[0]._sourceNames = std::move(names);
+	// A single track is already sorted.
+	if(tracks.size() < 2){
+		return;
+	}
+	std::vector<const std::vector<MIDINote> *> notes;
+	std::vector<const std::vector<MIDIPedal> *> pedals;
+	for(const auto & track : tracks){
+		notes.push_back(&track._notes);
+		pedals.push_back(&track._pedals);
+	}
+	std::vector<MIDINote> mergedNotes;
+	std::vector<MIDIPedal> mergedPedals;
+	mergeSorted(notes, mergedNotes, threads);
+	mergeSorted(pedals, mergedPedals, threads);
+	tracks[0]._notes = std::move(mergedNotes);
+	tracks[0]._pedals = std::move(mergedPedals);
+}
+
+void MIDITrack::restore(MIDINoteStore && notes, std::vector<MIDIPedal> && pedals, std::vector<std::string> && sourceNames){
+	_notes.clear();
+	_store = std::move(notes);
+	_pedals = std::move(pedals);
+	_sourceNames = std::move(sourceNames);
 }
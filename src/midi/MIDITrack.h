@@ -2,41 +2,124 @@
 #define MIDI_TRACK_H
 
 #include "MIDIBase.h"
+#include "TempoMap.h"
+#include "MIDINoteStore.h"
 
 typedef std::array<ActiveNoteInfos, 128> ActiveNotesArray;
 
 class MIDITrack {
 public:
 	
-	size_t readTrack(const std::vector<char>& buffer, size_t pos);
+	/// Decode events, notes, pedals and tempos (in MIDI units) in a single pass.
+	/// Raw events are only kept if requested.
+	size_t readTrack(const MIDIBuffer & buffer, size_t pos, bool keepEvents, NotePairing pairing = NotePairing::RETRIGGER);
 	
 	double extractTempos(std::vector<MIDITempo> & tempos) const;
 
-	void extractNotes(const std::vector<MIDITempo> & tempos, uint16_t unitsPerQuarterNote, unsigned int trackId);
+	void extractNotes(const TempoMap & tempos, unsigned int trackId);
 
 	void print() const;
 
+	void printEvents() const;
+
+	void printSummary() const;
+
 	void getNotes(std::vector<MIDINote> & notes, NoteType type) const;
 
+	/// Find the notes active at a given time. When several notes overlap on the same key, the last one in the track is used.
+	/// Requires the active notes index to be built.
 	void getNotesActive(ActiveNotesArray & actives, double time) const;
 
+	/// Same as above, only considering notes from the enabled source tracks (all of them if the list is empty).
+	void getNotesActive(ActiveNotesArray & actives, double time, const std::vector<bool> & tracksEnabled) const;
+
+	/// Find the indices of all notes active at a given time, in no specific order.
+	void getNotesActive(std::vector<size_t> & ids, double time) const;
+
+	/// Requires the indices to be built.
 	void getPedalsActive(bool & damper, bool &sostenuto, bool &soft, double time) const;
+
+	/// Smallest and largest keys played in the track, false if there are no notes.
+	bool getKeysRange(int & minKey, int & maxKey) const;
+
+	/// Is a pedal of a given type pressed at a given time, in logarithmic time. Requires the indices to be built.
+	bool isPedalActive(PedalType type, double time) const;
 	
-	void merge(MIDITrack & other);
+	/// Merge the notes and pedals of all tracks into the first one, ordered by start time, and keep the names of all tracks.
+	/// Each track is expected to be sorted already.
+	static void merge(std::vector<MIDITrack> & tracks, int threads);
+
+	/// Collapse notes of the same source track on the same key, whose starts and ends are both less than tolerance seconds apart, into the first one.
+	/// Notes of different tracks are kept, so that each track can still be hidden separately.
+	/// Notes have to be sorted by start time and not moved to the column store yet. Returns the number of notes removed.
+	size_t removeDuplicates(double tolerance);
+
+	/// Build the indices used to find active notes and pedals, once notes and pedals are final.
+	/// Notes are first moved to the column store.
+	void buildIndices();
+
+	/// Replace the content of the track with final notes (sorted by start time), pedals and source tracks names, for instance from a cache.
+	/// Indices have to be built afterwards.
+	void restore(MIDINoteStore && notes, std::vector<MIDIPedal> && pedals, std::vector<std::string> && sourceNames);
 
-	void updateSets(const SetOptions & options);
+	const std::vector<MIDIEvent> & events() const { return _events; }
+
+	/// Final notes, sorted by start time. Only available once indices are built.
+	const MIDINoteStore & noteStore() const { return _store; }
+
+	const std::vector<MIDIPedal> & pedals() const { return _pedals; }
+
+	/// Number of source tracks the notes come from, including tracks without notes. Requires the indices to be built.
+	size_t sourceTracksCount() const { return _tracksRanges.empty() ? 0 : _tracksRanges.size() - 1; }
+
+	/// Names of the source tracks merged in this track, empty before merging.
+	const std::vector<std::string> & sourceNames() const { return _sourceNames; }
+
+	/// Indices of the notes from a source track, sorted by start time. Requires the indices to be built.
+	void getTrackNotes(size_t track, const size_t * & ids, size_t & count) const;
+
+	/// Is a source track enabled in a list of flags (all are if the list is empty).
+	static bool isTrackEnabled(const std::vector<bool> & tracksEnabled, uint32_t track){
+		return tracksEnabled.empty() || track >= tracksEnabled.size() || tracksEnabled[track];
+	}
+
+	/// Meta or sysex event payload, event.length bytes read from the source buffer.
+	/// Only valid for kept events, as long as the buffer used for reading the track is alive.
+	const uint8_t * payload(const MIDIEvent & event) const { return reinterpret_cast<const uint8_t *>(_source.data + event.offset); }
 
 private:
 
-	std::pair<double, double> computeNoteTimings(const std::vector<MIDITempo> & tempos, size_t start,size_t end, uint16_t upqn) const;
+	void readMetaInfos(const MIDIBuffer & buffer, const MIDIEvent & event, size_t timeInUnits);
+
+	/// Notes of similar durations, sorted by start time.
+	struct DurationBucket {
+		std::vector<double> starts;
+		std::vector<double> ends;
+		std::vector<size_t> ids; ///< Indices in the notes store.
+		double maxDuration = 0.0;
+	};
 
 	std::vector<MIDIEvent> _events;
-	std::vector<MIDINote> _notes;
+	MIDIBuffer _source; ///< Buffer the kept events were read from.
+	std::vector<MIDINote> _notes; ///< Notes while loading.
+	MIDINoteStore _store; ///< Final notes.
 	std::vector<MIDIPedal> _pedals;
+	std::vector<MIDITempo> _tempos;
+	std::vector<DurationBucket> _activeIndex; ///< Notes grouped by power-of-two duration classes.
+	std::vector<size_t> _notesByTrack; ///< Notes indices grouped by source track, each group sorted by start time.
+	std::vector<size_t> _tracksRanges; ///< Start of each source track group in _notesByTrack, followed by the total count.
+	std::vector<std::string> _sourceNames; ///< Names of the source tracks.
+	std::array<std::vector<double>, 3> _pedalEdges; ///< For each pedal type, alternating press and release times of non-overlapping intervals.
+
+	// Start and end of notes and pedals in MIDI units, until they are converted to seconds.
+	std::vector<std::pair<size_t, size_t>> _notesUnits;
+	std::vector<std::pair<size_t, size_t>> _pedalsUnits;
 
 	std::string _name;
 	std::string _instrument;
-	uint8_t _previousEventFirstByte = 0x0;
+	uint32_t _length = 0;
+	double _signature = 4.0/4.0;
+	bool _minorKey = false;
 
 };
 
@@ -7,6 +7,7 @@
 #include <string>
 #include <iostream>
 #include <array>
+#include <functional>
 
 enum class SetMode : int {
 	CHANNEL = 0,
@@ -19,6 +20,32 @@ struct SetOptions {
 	int key = 64;
 };
 
+/// Set of a note, depending on the grouping mode.
+inline int computeSet(const SetOptions & options, uint8_t channel, uint32_t track, uint8_t key){
+	if(options.mode == SetMode::CHANNEL){
+		return int(channel);
+	} else if(options.mode == SetMode::TRACK){
+		return int(track);
+	} else if(options.mode == SetMode::KEY){
+		return key < options.key ? 0 : 1;
+	}
+	return 0;
+}
+
+enum class NotePairing : int {
+	RETRIGGER = 0, ///< A new note on the same key and channel ends the current one.
+	FIFO = 1, ///< Overlapping notes are stacked, a note off ends the oldest one.
+	LIFO = 2 ///< Overlapping notes are stacked, a note off ends the most recent one.
+};
+
+struct LoadOptions {
+	int threads = 0; ///< Number of threads used for parsing, 0 to use all available cores.
+	NotePairing pairing = NotePairing::RETRIGGER; ///< How note on/off events are matched on a given key and channel.
+	bool cache = false; ///< Reuse (or create) a binary cache of the loaded notes next to the MIDI file.
+	bool deduplicate = false; ///< Collapse identical notes of a track (same key, start and end), once all tracks are merged.
+	float duplicateTolerance = 0.001f; ///< Maximum start and end differences of duplicate notes, in seconds.
+};
+
 enum MIDIType : uint16_t {
 	singleTrack = 0,
 	tempoTrack = 1,
@@ -54,7 +81,7 @@ enum MIDIEventType : uint8_t {
 	
 };
 
-enum class EventCategory {
+enum class EventCategory : uint8_t {
 	MIDI, SYSTEM, META
 };
 
@@ -82,7 +109,20 @@ extern const char midiKeysString[];
 
 // Read data.
 
-inline uint32_t read32(const std::vector<char>& buffer, size_t position){
+/// Read-only view over raw MIDI bytes, either memory-mapped or buffered. Does not own the data.
+struct MIDIBuffer {
+
+	MIDIBuffer() {}
+
+	MIDIBuffer(const char * aData, size_t aSize) : data(aData), size(aSize) {}
+
+	char operator[](size_t position) const { return data[position]; }
+
+	const char * data = nullptr;
+	size_t size = 0;
+};
+
+inline uint32_t read32(const MIDIBuffer& buffer, size_t position){
 	return (buffer[position] & 0xFF) << 24 | (buffer[position+1] & 0xFF) << 16 | (buffer[position+2] & 0xFF) << 8 | (buffer[position+3] & 0xFF);
 }
 
@@ -90,7 +130,7 @@ inline uint8_t getBit(uint32_t number, short bit){
 	return (number & (0x1 << bit)) >> bit;
 }
 
-inline uint16_t read16(const std::vector<char>& buffer, size_t position){
+inline uint16_t read16(const MIDIBuffer& buffer, size_t position){
 	return (buffer[position] & 0xFF) << 8 | (buffer[position+1] & 0xFF);
 }
 
@@ -98,7 +138,7 @@ inline uint8_t getBit(uint16_t number, short bit){
 	return (number & (0x1 << bit)) >> bit;
 }
 
-inline uint8_t read8(const std::vector<char>& buffer, size_t position){
+inline uint8_t read8(const MIDIBuffer& buffer, size_t position){
 	return buffer[position] & 0xFF;
 }
 
@@ -106,20 +146,26 @@ inline uint8_t getBit(uint8_t number, short bit){
 	return (number & (0x1 << bit)) >> bit;
 }
 
-inline size_t readVarLen(const std::vector<char>& buffer, size_t & position){
-	size_t lastIndex = 0;
+/// Read a variable-length quantity, stopping at end if it is truncated.
+inline size_t readVarLen(const MIDIBuffer& buffer, size_t & position, size_t end){
 	size_t accum = 0;
-	uint8_t currentByte = read8(buffer, position + lastIndex);
-	while(currentByte & 0x80){
+	while(position < end){
+		const uint8_t currentByte = read8(buffer, position);
+		++position;
 		accum = (accum << 7) | (currentByte & 0x7F);
-		lastIndex += 1;
-		currentByte = read8(buffer, position + lastIndex);
+		if(!(currentByte & 0x80)){
+			break;
+		}
 	}
-	accum = (accum << 7) | (currentByte & 0x7F);
-	position = position + lastIndex + 1;
 	return accum;
 }
 
+// Parallel processing.
+
+/// Call func(i) for each i in [0, count), spread over the requested number of threads (0 for all cores).
+/// Items are distributed dynamically, each index is processed exactly once.
+void parallelFor(size_t count, int threads, const std::function<void(size_t)> & func);
+
 // Time computations.
 
 inline double computeMeasureDuration(int tempo, double signature){
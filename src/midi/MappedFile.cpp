@@ -0,0 +1,179 @@
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+
+std::wstring widen(const std::string & str){
+	const int size = MultiByteToWideChar(CP_UTF8, 0, str.c_str(), int(str.size()), NULL, 0);
+	std::wstring res(size_t((std::max)(size, 0)), 0);
+	if(size > 0){
+		MultiByteToWideChar(CP_UTF8, 0, str.c_str(), int(str.size()), &res[0], size);
+	}
+	return res;
+}
+
+std::string narrow(WCHAR * str){
+	const int size = WideCharToMultiByte(CP_UTF8, 0, str, -1, NULL, 0, NULL, NULL);
+	std::string res(size - 1, 0);
+	WideCharToMultiByte(CP_UTF8, 0, str, -1, &res[0], size, NULL, NULL);
+	return res;
+}
+
+bool removeFile(const std::string & path){
+	return DeleteFileW(widen(path).c_str()) != 0;
+}
+
+bool replaceFile(const std::string & from, const std::string & to){
+	return MoveFileExW(widen(from).c_str(), widen(to).c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+#else
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+std::string widen(const std::string & str){
+	return str;
+}
+std::string narrow(char * str) {
+	return std::string(str);
+}
+
+bool removeFile(const std::string & path){
+	return std::remove(path.c_str()) == 0;
+}
+
+bool replaceFile(const std::string & from, const std::string & to){
+	// rename replaces the destination atomically.
+	return std::rename(from.c_str(), to.c_str()) == 0;
+}
+
+#endif
+
+MappedFile::MappedFile(){}
+
+MappedFile::~MappedFile(){
+	close();
+}
+
+bool MappedFile::open(const std::string & path){
+	close();
+	// Map regular files, and fall back to a buffered copy for anything else.
+	if(map(path)){
+		return true;
+	}
+	return load(path);
+}
+
+#ifdef _WIN32
+
+bool MappedFile::map(const std::string & path){
+	HANDLE file = CreateFileW(widen(path).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(file == INVALID_HANDLE_VALUE){
+		return false;
+	}
+	LARGE_INTEGER size;
+	if(GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size) || size.QuadPart == 0){
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(mapping == NULL){
+		CloseHandle(file);
+		return false;
+	}
+	void * data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if(data == NULL){
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	_file = file;
+	_mapping = mapping;
+	_data = static_cast<const char *>(data);
+	_size = size_t(size.QuadPart);
+	_mapped = true;
+	return true;
+}
+
+void MappedFile::close(){
+	if(_mapped){
+		UnmapViewOfFile(_data);
+		CloseHandle(_mapping);
+		CloseHandle(_file);
+		_file = _mapping = nullptr;
+	}
+	_fallback.clear();
+	_fallback.shrink_to_fit();
+	_data = nullptr;
+	_size = 0;
+	_mapped = false;
+}
+
+#else
+
+bool MappedFile::map(const std::string & path){
+	const int file = ::open(widen(path).c_str(), O_RDONLY);
+	if(file < 0){
+		return false;
+	}
+	struct stat infos;
+	if(fstat(file, &infos) != 0 || !S_ISREG(infos.st_mode) || infos.st_size == 0){
+		::close(file);
+		return false;
+	}
+	const size_t size = size_t(infos.st_size);
+	void * data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+	// The mapping stays valid once the descriptor is closed.
+	::close(file);
+	if(data == MAP_FAILED){
+		return false;
+	}
+	// We parse the file front to back.
+	madvise(data, size, MADV_SEQUENTIAL);
+	_data = static_cast<const char *>(data);
+	_size = size;
+	_mapped = true;
+	return true;
+}
+
+void MappedFile::close(){
+	if(_mapped){
+		munmap(const_cast<char *>(_data), _size);
+	}
+	_fallback.clear();
+	_fallback.shrink_to_fit();
+	_data = nullptr;
+	_size = 0;
+	_mapped = false;
+}
+
+#endif
+
+bool MappedFile::load(const std::string & path){
+	std::ifstream input(widen(path).c_str(), std::ios::in|std::ios::binary);
+	if(!input.is_open()) {
+		return false;
+	}
+	// The size is unknown for pipes, read by large blocks.
+	const size_t blockSize = 1 << 20;
+	size_t size = 0;
+	while(input){
+		_fallback.resize(size + blockSize);
+		input.read(&_fallback[size], std::streamsize(blockSize));
+		size += size_t(input.gcount());
+	}
+	input.close();
+	_fallback.resize(size);
+	_data = _fallback.data();
+	_size = _fallback.size();
+	_mapped = false;
+	return true;
+}
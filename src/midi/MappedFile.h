@@ -0,0 +1,59 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include "MIDIUtils.h"
+
+/// Convert an UTF-8 path for use with system and standard file functions.
+#ifdef _WIN32
+std::wstring widen(const std::string & str);
+#else
+std::string widen(const std::string & str);
+#endif
+
+/// Delete a file, with an UTF-8 path.
+bool removeFile(const std::string & path);
+
+/// Move a file, replacing the destination if it exists, with UTF-8 paths.
+bool replaceFile(const std::string & from, const std::string & to);
+
+/// Read-only access to the content of a file on disk.
+/// Regular files are memory-mapped and read in place, other inputs (pipes,...) are copied to memory.
+class MappedFile {
+public:
+
+	MappedFile();
+
+	~MappedFile();
+
+	MappedFile(const MappedFile &) = delete;
+
+	MappedFile & operator=(const MappedFile &) = delete;
+
+	bool open(const std::string & path);
+
+	void close();
+
+	MIDIBuffer buffer() const { return MIDIBuffer(_data, _size); }
+
+	bool isMapped() const { return _mapped; }
+
+private:
+
+	bool map(const std::string & path);
+
+	bool load(const std::string & path);
+
+	const char * _data = nullptr;
+	size_t _size = 0;
+	bool _mapped = false;
+
+	std::vector<char> _fallback; ///< Copy of the content when mapping is not possible.
+
+#ifdef _WIN32
+	void * _file = nullptr;
+	void * _mapping = nullptr;
+#endif
+
+};
+
+#endif // MAPPED_FILE_H
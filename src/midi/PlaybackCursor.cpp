@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <limits>
+
+#include "PlaybackCursor.h"
+
+PlaybackCursor::PlaybackCursor(){
+	_time = -std::numeric_limits<double>::infinity();
+}
+
+void PlaybackCursor::reset(const MIDITrack & track){
+	_track = &track;
+	_time = -std::numeric_limits<double>::infinity();
+	_nextNoteStart = _nextNoteEnd = 0;
+	for(auto & key : _activeNotes){
+		key.clear();
+	}
+
+	// Order notes by end time.
+	const auto & ends = track.noteStore().ends;
+	_notesByEnd.resize(ends.size());
+	for(size_t i = 0; i < ends.size(); ++i){
+		_notesByEnd[i] = i;
+	}
+	std::stable_sort(_notesByEnd.begin(), _notesByEnd.end(), [&ends](size_t a, size_t b){
+		return ends[a] < ends[b];
+	});
+}
+
+void PlaybackCursor::update(double time){
+	if(_track == nullptr || time == _time){
+		return;
+	}
+	if(time < _time){
+		seek(time);
+		return;
+	}
+	_time = time;
+	// Start notes first, so that short ones starting and ending between two updates are properly removed.
+	const auto & notes = _track->noteStore();
+	for(; _nextNoteStart < notes.size() && notes.starts[_nextNoteStart] <= time; ++_nextNoteStart){
+		addNote(_nextNoteStart);
+	}
+	for(; _nextNoteEnd < _notesByEnd.size(); ++_nextNoteEnd){
+		if(notes.ends[_notesByEnd[_nextNoteEnd]] >= time){
+			break;
+		}
+		removeNote(_notesByEnd[_nextNoteEnd]);
+	}
+}
+
+void PlaybackCursor::seek(double time){
+	_time = time;
+	for(auto & key : _activeNotes){
+		key.clear();
+	}
+
+	// Skip all notes that have started, and all that have ended.
+	const auto & starts = _track->noteStore().starts;
+	const auto & ends = _track->noteStore().ends;
+	_nextNoteStart = size_t(std::upper_bound(starts.begin(), starts.end(), time) - starts.begin());
+	_nextNoteEnd = size_t(std::lower_bound(_notesByEnd.begin(), _notesByEnd.end(), time, [&ends](size_t id, double t){
+		return ends[id] < t;
+	}) - _notesByEnd.begin());
+	// Query the notes active at this time from the track index.
+	std::vector<size_t> ids;
+	_track->getNotesActive(ids, time);
+	for(const size_t id : ids){
+		addNote(id);
+	}
+}
+
+void PlaybackCursor::addNote(size_t id){
+	_activeNotes[_track->noteStore().keys[id]].push_back(id);
+}
+
+void PlaybackCursor::removeNote(size_t id){
+	auto & key = _activeNotes[_track->noteStore().keys[id]];
+	const auto it = std::find(key.begin(), key.end(), id);
+	if(it != key.end()){
+		*it = key.back();
+		key.pop_back();
+	}
+}
+
+void PlaybackCursor::getNotesActive(ActiveNotesArray & actives, const std::vector<bool> & tracksEnabled) const {
+	const size_t none = std::numeric_limits<size_t>::max();
+	for(size_t key = 0; key < actives.size(); ++key){
+		const auto & ids = _activeNotes[key];
+		actives[key].enabled = false;
+		if(ids.empty()){
+			continue;
+		}
+		const auto & notes = _track->noteStore();
+		size_t id = none;
+		for(const size_t candidate : ids){
+			if(MIDITrack::isTrackEnabled(tracksEnabled, notes.tracks[candidate]) && (id == none || candidate > id)){
+				id = candidate;
+			}
+		}
+		if(id == none){
+			continue;
+		}
+		actives[key].enabled = true;
+		actives[key].duration = float(notes.duration(id));
+		actives[key].start = float(notes.starts[id]);
+		actives[key].channel = notes.channels[id];
+		actives[key].track = notes.tracks[id];
+	}
+}
+
+void PlaybackCursor::getPedalsActive(bool & damper, bool &sostenuto, bool &soft) const {
+	damper = sostenuto = soft = false;
+	if(_track != nullptr){
+		_track->getPedalsActive(damper, sostenuto, soft, _time);
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef PLAYBACK_CURSOR_H
+#define PLAYBACK_CURSOR_H
+
+#include "MIDITrack.h"
+
+/// Keep track of active notes and pedals while playing a track.
+/// Moving forward only processes the notes starting or ending since the previous time,
+/// moving backward falls back to an indexed seek.
+class PlaybackCursor {
+public:
+
+	PlaybackCursor();
+
+	/// Start over on a new track, its notes must be sorted by start time.
+	void reset(const MIDITrack & track);
+
+	/// Move to a given time.
+	void update(double time);
+
+	/// Active notes at the current time. When several notes overlap on the same key, the last one in the track is used.
+	/// Only notes from the enabled source tracks are considered (all of them if the list is empty).
+	void getNotesActive(ActiveNotesArray & actives, const std::vector<bool> & tracksEnabled = std::vector<bool>()) const;
+
+	/// Active pedals at the current time.
+	void getPedalsActive(bool & damper, bool &sostenuto, bool &soft) const;
+
+private:
+
+	void seek(double time);
+
+	void addNote(size_t id);
+
+	void removeNote(size_t id);
+
+	const MIDITrack * _track = nullptr;
+	double _time;
+
+	std::vector<size_t> _notesByEnd; ///< Note indices sorted by end time.
+	size_t _nextNoteStart = 0;
+	size_t _nextNoteEnd = 0;
+	std::array<std::vector<size_t>, 128> _activeNotes; ///< Indices of the notes active on each key.
+
+};
+
+#endif // PLAYBACK_CURSOR_H
@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <limits>
+#include <iterator>
+
+#include "TempoMap.h"
+
+TempoMap::TempoMap(){
+	_tempos.emplace_back(0, 500000);
+}
+
+TempoMap::TempoMap(const std::vector<MIDITempo> & changes, uint16_t unitsPerQuarterNote) : _unitsPerQuarterNote(unitsPerQuarterNote) {
+	// Emplace default tempo, will be overwritten as soon as there is an initial tempo event.
+	std::vector<MIDITempo> sortedChanges;
+	sortedChanges.reserve(changes.size() + 1);
+	sortedChanges.emplace_back(0, 500000);
+	// A null tempo can't be converted back from seconds, skip it.
+	std::copy_if(changes.begin(), changes.end(), std::back_inserter(sortedChanges), [](const MIDITempo & tempo){
+		return tempo.tempo != 0;
+	});
+	// Preserve the order of simultaneous changes.
+	std::stable_sort(sortedChanges.begin(), sortedChanges.end(), [](const MIDITempo& a, const MIDITempo& b){
+		return a.start < b.start;
+	});
+	for(const auto & tempo : sortedChanges){
+		if(!_tempos.empty() && _tempos.back().start == tempo.start){
+			_tempos.back() = tempo;
+		} else {
+			_tempos.push_back(tempo);
+		}
+	}
+
+	// Compute the real time stamp of each tempo.
+	// We are guaranteed that there is an event at t = 0.
+	double currentTime = 0.0;
+	_tempos[0].timestamp = 0.0;
+	for(size_t tid = 1; tid < _tempos.size(); ++tid){
+		const size_t delta = _tempos[tid].start - _tempos[tid-1].start;
+		currentTime += computeUnitsDuration(_tempos[tid-1].tempo, delta, _unitsPerQuarterNote);
+		_tempos[tid].timestamp = currentTime;
+	}
+}
+
+size_t TempoMap::index(size_t ticks) const {
+	// Find the first tempo starting after the position, the previous one is active.
+	const auto next = std::upper_bound(_tempos.begin(), _tempos.end(), ticks, [](size_t value, const MIDITempo & tempo){
+		return value < tempo.start;
+	});
+	return (std::max)(size_t(next - _tempos.begin()), size_t(1)) - 1;
+}
+
+void TempoMap::seconds(const std::vector<size_t> & ticks, std::vector<double> & seconds) const {
+	const size_t count = ticks.size();
+	seconds.resize(count);
+	size_t tid = 0;
+	size_t first = 0;
+	while(first < count){
+		// Move to the next tempo if needed, or search for it if the positions were not sorted.
+		if(ticks[first] < _tempos[tid].start || (tid + 1 < _tempos.size() && ticks[first] >= _tempos[tid+1].start)){
+			tid = index(ticks[first]);
+		}
+		const size_t startUnits = _tempos[tid].start;
+		const size_t endUnits = tid + 1 < _tempos.size() ? _tempos[tid+1].start : std::numeric_limits<size_t>::max();
+		size_t last = first + 1;
+		while(last < count && ticks[last] >= startUnits && ticks[last] < endUnits){
+			++last;
+		}
+		// All positions in the range share the same tempo, convert them in a branchless loop.
+		const double timestamp = _tempos[tid].timestamp;
+		const double unitDuration = double(_tempos[tid].tempo) / double(_unitsPerQuarterNote);
+		for(size_t i = first; i < last; ++i){
+			seconds[i] = (timestamp + unitDuration * double(ticks[i] - startUnits)) / 1000000.0;
+		}
+		first = last;
+	}
+}
+
+double TempoMap::ticks(double seconds) const {
+	const double time = (std::max)(seconds, 0.0) * 1000000.0;
+	// Find the first tempo starting after the time, the previous one is active.
+	const auto next = std::upper_bound(_tempos.begin(), _tempos.end(), time, [](double value, const MIDITempo & tempo){
+		return value < tempo.timestamp;
+	});
+	const MIDITempo & tempo = _tempos[(std::max)(size_t(next - _tempos.begin()), size_t(1)) - 1];
+	return double(tempo.start) + (time - tempo.timestamp) * double(_unitsPerQuarterNote) / double(tempo.tempo);
+}
+
+double TempoMap::Cursor::seconds(size_t ticks){
+	const auto & tempos = _map._tempos;
+	if(ticks < tempos[_current].start){
+		_current = _map.index(ticks);
+	} else {
+		while(_current + 1 < tempos.size() && tempos[_current+1].start <= ticks){
+			++_current;
+		}
+	}
+	return _map.seconds(ticks, _current);
+}
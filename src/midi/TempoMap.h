@@ -0,0 +1,61 @@
+#ifndef TEMPO_MAP_H
+#define TEMPO_MAP_H
+
+#include "MIDIUtils.h"
+#include "MIDIBase.h"
+
+/// Conversion between MIDI units (ticks) and seconds, for a sorted list of tempo changes.
+/// Each tempo stores the time at which it starts, so any conversion only has to locate the right tempo.
+class TempoMap {
+public:
+
+	/// Cursor for conversions of increasing positions, in amortized constant time.
+	/// Going backward is supported, but falls back to a binary search.
+	class Cursor {
+	public:
+
+		Cursor(const TempoMap & map) : _map(map) {}
+
+		/// Time in seconds of a position in units.
+		double seconds(size_t ticks);
+
+	private:
+
+		const TempoMap & _map;
+		size_t _current = 0; ///< Index of the tempo used for the last conversion.
+	};
+
+	TempoMap();
+
+	/// Build the map from tempo changes in any order. For changes happening at the same time, the last one wins.
+	/// The default tempo (120 BPM) is used until the first change. Null tempos are ignored.
+	TempoMap(const std::vector<MIDITempo> & changes, uint16_t unitsPerQuarterNote);
+
+	/// Index of the tempo active at a given position in units, in logarithmic time.
+	size_t index(size_t ticks) const;
+
+	/// Time in seconds of a position in units.
+	double seconds(size_t ticks) const { return seconds(ticks, index(ticks)); }
+
+	/// Convert positions in units sorted in increasing order to seconds, in a single sweep.
+	void seconds(const std::vector<size_t> & ticks, std::vector<double> & seconds) const;
+
+	/// Position in units (can be fractional) of a time in seconds.
+	double ticks(double seconds) const;
+
+	const MIDITempo & operator[](size_t i) const { return _tempos[i]; }
+
+	size_t size() const { return _tempos.size(); }
+
+private:
+
+	/// Time in seconds of a position in units, using the tempo at the given index.
+	double seconds(size_t ticks, size_t tid) const {
+		return (_tempos[tid].timestamp + computeUnitsDuration(_tempos[tid].tempo, ticks - _tempos[tid].start, _unitsPerQuarterNote)) / 1000000.0;
+	}
+
+	std::vector<MIDITempo> _tempos; ///< Sorted tempo changes, with their timestamps in microseconds.
+	uint16_t _unitsPerQuarterNote = 1;
+};
+
+#endif // TEMPO_MAP_H
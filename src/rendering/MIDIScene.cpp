@@ -2,6 +2,7 @@
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <limits>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "../helpers/ProgramUtilities.h"
@@ -17,57 +18,145 @@
 MIDIScene::~MIDIScene(){}
 
 MIDIScene::MIDIScene(){
-	std::vector<float> data(5, 0.0f);
 	renderSetup();
-	upload(data);
+	updateSets(_setOptions);
+	setTracksVisibility({}, -1);
 }
 
-MIDIScene::MIDIScene(const std::string & midiFilePath, const SetOptions & options) {
+MIDIScene::MIDIScene(const std::string & midiFilePath, const SetOptions & options, const LoadOptions & loadOptions, size_t notesBudget) {
 	
 	// MIDI processing.
-	_midiFile = MIDIFile(midiFilePath);
+	_midiFile = MIDIFile(midiFilePath, loadOptions);
+	_cursor.reset(_midiFile.track(0));
 
 	renderSetup();
 
+	// Load notes shared data.
+	std::vector<GPUNote> data;
+	std::vector<size_t> ranges;
+	packNotes(_midiFile, data, ranges, loadOptions.threads);
+	// Upload to the GPU.
+	setNotesBudget(notesBudget);
+	startUpload(std::move(data), std::move(ranges));
+	continueUpload(std::numeric_limits<size_t>::max());
+
 	updateSets(options);
+	setTracksVisibility({}, -1);
+
+	std::cout << "[INFO]: Final track duration " << _midiFile.duration() << " sec." << std::endl;
+}
+
+MIDIScene::MIDIScene(MIDIFile && midiFile) : _midiFile(std::move(midiFile)) {
+	_cursor.reset(_midiFile.track(0));
+
+	renderSetup();
+	updateSets(_setOptions);
+	setTracksVisibility({}, -1);
 
 	std::cout << "[INFO]: Final track duration " << _midiFile.duration() << " sec." << std::endl;
 }
 
 
 void MIDIScene::updateSets(const SetOptions & options){
-	// Generate note data for rendering.
-	_midiFile.updateSets(options);
+	_setOptions = options;
+	glUseProgram(_programId);
+	glUniform1i(glGetUniformLocation(_programId, "setMode"), int(options.mode));
+	glUniform1i(glGetUniformLocation(_programId, "setKey"), options.key);
+	glUseProgram(0);
+}
 
-	// Load notes shared data.
-	std::vector<float> data;
-	std::vector<MIDINote> notesM;
-	_midiFile.getNotes(notesM, NoteType::MAJOR, 0);
-	for(auto& note : notesM){
-		data.push_back(float(note.note));
-		data.push_back(float(note.start));
-		data.push_back(float(note.duration));
-		data.push_back(0.0f);
-		data.push_back(float(note.set % CHANNELS_COUNT));
+void MIDIScene::setTracksVisibility(const std::vector<int> & hiddenTracks, int soloTrack){
+	const size_t count = tracksCount();
+	const bool solo = soloTrack >= 0 && size_t(soloTrack) < count;
+	_tracksEnabled.assign(count, !solo);
+	if(solo){
+		_tracksEnabled[soloTrack] = true;
+		return;
+	}
+	for(const int track : hiddenTracks){
+		if(track >= 0 && size_t(track) < count){
+			_tracksEnabled[track] = false;
+		}
 	}
+}
+
+size_t MIDIScene::tracksCount() const {
+	return _midiFile.tracksCount() == 0 ? 0 : _midiFile.track(0).sourceTracksCount();
+}
 
-	std::vector<MIDINote> notesm;
-	_midiFile.getNotes(notesm, NoteType::MINOR, 0);
-	for(auto& note : notesm){
-		data.push_back(float(note.note));
-		data.push_back(float(note.start));
-		data.push_back(float(note.duration));
-		data.push_back(1.0f);
-		data.push_back(float(note.set % CHANNELS_COUNT));
+std::string MIDIScene::trackName(size_t track) const {
+	if(_midiFile.tracksCount() == 0 || track >= _midiFile.track(0).sourceNames().size()){
+		return "";
 	}
-	// Upload to the GPU.
-	upload(data);
+	return _midiFile.track(0).sourceNames()[track];
 }
 
-void MIDIScene::upload(const std::vector<float> & data){
-	glBindBuffer(GL_ARRAY_BUFFER, _dataBuffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * data.size(), &(data[0]), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+void MIDIScene::packNotes(const MIDIFile & midiFile, std::vector<GPUNote> & data, std::vector<size_t> & ranges, int threads){
+	data.clear();
+	ranges.assign(1, 0);
+	if(midiFile.tracksCount() == 0){
+		return;
+	}
+	// Slices of consecutive notes by start time, then majors and minors, then tracks,
+	// so that each slice can be streamed and each track drawn separately.
+	const MIDITrack & track = midiFile.track(0);
+	const MIDINoteStore & notes = track.noteStore();
+	const size_t tracksCount = track.sourceTracksCount();
+	const size_t slicesCount = (notes.size() + NOTES_SLICE_SIZE - 1) / NOTES_SLICE_SIZE;
+	const size_t groupsCount = slicesCount * 2 * tracksCount;
+
+	// Count the notes of each group to locate them.
+	std::vector<size_t> counts(groupsCount, 0);
+	parallelFor(tracksCount, threads, [&track, &notes, &counts, tracksCount](size_t tid){
+		const size_t * ids = nullptr;
+		size_t count = 0;
+		track.getTrackNotes(tid, ids, count);
+		for(size_t nid = 0; nid < count; ++nid){
+			const size_t i = ids[nid];
+			const size_t pass = noteIsMinor[notes.keys[i] % 12] ? 1 : 0;
+			++counts[((i / NOTES_SLICE_SIZE) * 2 + pass) * tracksCount + tid];
+		}
+	});
+	ranges.resize(groupsCount + 1);
+	size_t offset = 0;
+	for(size_t gid = 0; gid < groupsCount; ++gid){
+		ranges[gid] = offset;
+		offset += counts[gid];
+	}
+	ranges.back() = offset;
+
+	// Pack each track directly at its locations. Notes of a track are sorted, so its slices are visited in order.
+	data.resize(offset);
+	parallelFor(tracksCount, threads, [&track, &notes, &data, &ranges, tracksCount](size_t tid){
+		const size_t * ids = nullptr;
+		size_t count = 0;
+		track.getTrackNotes(tid, ids, count);
+		size_t slice = std::numeric_limits<size_t>::max();
+		size_t dsts[2] = {0, 0};
+		for(size_t nid = 0; nid < count; ++nid){
+			const size_t i = ids[nid];
+			if(i / NOTES_SLICE_SIZE != slice){
+				slice = i / NOTES_SLICE_SIZE;
+				dsts[0] = ranges[(slice * 2) * tracksCount + tid];
+				dsts[1] = ranges[(slice * 2 + 1) * tracksCount + tid];
+			}
+			const uint8_t key = notes.keys[i];
+			const size_t dst = dsts[noteIsMinor[key % 12] ? 1 : 0]++;
+			data[dst] = GPUNote(notes.starts[i], notes.duration(i), key, notes.channels[i], notes.tracks[i]);
+		}
+	});
+}
+
+void MIDIScene::startUpload(std::vector<GPUNote> && data, std::vector<size_t> && ranges){
+	_notesBuffer.setNotes(std::move(data), std::move(ranges), tracksCount());
+}
+
+bool MIDIScene::continueUpload(size_t maxSize){
+	return _notesBuffer.preload(maxSize);
+}
+
+void MIDIScene::setNotesBudget(size_t budget){
+	_notesBuffer.setBudget(budget);
 }
 
 void MIDIScene::renderSetup(){
@@ -82,12 +171,6 @@ void MIDIScene::renderSetup(){
 	// Upload the data to the Array buffer.
 	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vertices.size(), &(vertices[0]), GL_STATIC_DRAW);
 
-	// Notes buffer.
-	_dataBuffer = 0;
-	glGenBuffers(1, &_dataBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, _dataBuffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 1000, nullptr, GL_STATIC_DRAW);
-
 	// Enabled notes buffer (empty for now).
 	_flagsBufferId = 0;
 	glGenBuffers(1, &_flagsBufferId);
@@ -116,18 +199,10 @@ void MIDIScene::renderSetup(){
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, NULL);
 	glVertexAttribDivisor(0, 0);
 
-	// The second attribute will be the notes data.
+	// The second attribute will be the packed notes data, its buffer is bound at draw time.
 	glEnableVertexAttribArray(1);
-	glBindBuffer(GL_ARRAY_BUFFER, _dataBuffer);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), NULL);
 	glVertexAttribDivisor(1, 1);
 
-	// The second attribute will be the notes data.
-	glEnableVertexAttribArray(2);
-	glBindBuffer(GL_ARRAY_BUFFER, _dataBuffer);
-	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)(4 * sizeof(GLfloat)));
-	glVertexAttribDivisor(2, 1);
-
 	// We load the indices data
 	glGenBuffers(1, &_ebo);
  	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
@@ -188,6 +263,19 @@ void MIDIScene::renderSetup(){
 	GLuint texUniID2 = glGetUniformLocation(_programParticulesId, "lookParticles");
 	glUniform1i(texUniID2, 1);
 
+	// Active particles systems parameters.
+	glGenBuffers(1, &_particlesSystemsBuffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, _particlesSystemsBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4) * 256, nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glGenTextures(1, &_texParticlesSystems);
+	glBindTexture(GL_TEXTURE_BUFFER, _texParticlesSystems);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, _particlesSystemsBuffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glUseProgram(_programParticulesId);
+	GLuint texUniID3 = glGetUniformLocation(_programParticulesId, "systems");
+	glUniform1i(texUniID3, 2);
+
 	// Pass texture size to shader.
 	const glm::vec2 tsize = ResourcesManager::getTextureSizeFor("particles");
 	GLuint texSizeID = glGetUniformLocation(_programParticulesId, "inverseTextureSize");
@@ -271,10 +359,11 @@ void MIDIScene::renderSetup(){
 	_actives.fill(-1);
 	_previousTime = 0.0;
 	// Particle systems pool.
-	_particles = std::vector<Particles>(256);
+	resetParticles();
 }
 
 void MIDIScene::setScaleAndMinorWidth(const float scale, const float minorWidth){
+	_scale = scale;
 	glUseProgram(_programId);
 	GLuint speedID = glGetUniformLocation(_programId, "mainSpeed");
 	glUniform1f(speedID, scale);
@@ -308,48 +397,101 @@ void MIDIScene::setKeyboardSize(float keyboardHeight){
 }
 
 void MIDIScene::updatesActiveNotes(double time){
-	// Update the particle systems lifetimes.
-	for(auto & particle : _particles){
+	// Update the lifetimes of the particle systems in use, and release the finished ones.
+	auto newEnd = std::remove_if(_particlesActive.begin(), _particlesActive.end(), [this, time](size_t id){
+		Particles & particle = _particles[id];
 		// Give a bit of a head start to the animation.
 		particle.elapsed = (float(time) - particle.start + 0.25f) / particle.duration;
-		// Disable old particles.
-		if(float(time) >= particle.start + particle.duration){
-			particle.note = -1;
-			particle.set = -1;
-			particle.duration = particle.start = particle.elapsed = 0.0f;
+		if(float(time) < particle.start + particle.duration){
+			return false;
 		}
-	}
+		particle.note = -1;
+		particle.set = -1;
+		particle.duration = particle.start = particle.elapsed = 0.0f;
+		_particlesFree.push_back(id);
+		return true;
+	});
+	_particlesActive.erase(newEnd, _particlesActive.end());
 	// Get notes actives.
 	auto actives = ActiveNotesArray();
-	_midiFile.getNotesActive(actives, time, 0);
+	_cursor.update(time);
+	_cursor.getNotesActive(actives, _tracksEnabled);
+	// Stream the notes data needed for the next frames.
+	_notesBuffer.update(time, 2.0 / (std::max)(double(_scale), 0.001));
 	for(int i = 0; i < 128; ++i){
 		const auto & note = actives[i];
-		const int clamped = note.set % CHANNELS_COUNT;
+		const int clamped = computeSet(_setOptions, note.channel, note.track, uint8_t(i)) % CHANNELS_COUNT;
 		_actives[i] = note.enabled ? clamped : -1;
 		// Check if the note was triggered at this frame.
 		if(note.start > _previousTime && note.start <= time){
-			// Find an available particles system and update it with the note parameters.
-			for(auto & particle : _particles){
-				if(particle.note < 0){
-					// Update with new note parameter.
-					particle.duration = (std::max)(note.duration*2.0f, note.duration + 1.2f);
-					particle.start = note.start;
-					particle.note = i;
-					particle.set = clamped;
-					particle.elapsed = 0.0f;
-					break;
-				}
-			}
+			// Update an available particles system with the note parameters.
+			Particles & particle = _particles[allocateParticles()];
+			particle.duration = (std::max)(note.duration*2.0f, note.duration + 1.2f);
+			particle.start = note.start;
+			particle.note = i;
+			particle.set = clamped;
+			particle.elapsed = 0.0f;
 		}
 	}
 	_previousTime = time;
+
+	// Gather the active particles systems, shared by all particles draws of the frame.
+	_particlesSystems.clear();
+	for(const size_t id : _particlesActive){
+		const Particles & particle = _particles[id];
+		_particlesSystems.emplace_back(float(particle.note), float(particle.set), particle.elapsed, particle.duration);
+	}
+	_particlesSystemsCount = _particlesSystems.size();
+	if(_particlesSystemsCount > 0){
+		glBindBuffer(GL_TEXTURE_BUFFER, _particlesSystemsBuffer);
+		// Orphan the previous content, that might still be in use by the GPU.
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4) * _particles.size(), nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(glm::vec4) * _particlesSystemsCount, &_particlesSystems[0]);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+}
+
+size_t MIDIScene::allocateParticles(){
+	size_t id = 0;
+	if(!_particlesFree.empty()){
+		id = _particlesFree.back();
+		_particlesFree.pop_back();
+	} else if(_particles.size() < _particlesMaxSystems){
+		id = _particles.size();
+		_particles.emplace_back();
+	} else {
+		// Pool full, replace the oldest system.
+		id = _particlesActive.front();
+		_particlesActive.pop_front();
+		if(_particlesDropped == 0){
+			std::cerr << "[WARN]: Too many particles systems, the oldest ones will be replaced." << std::endl;
+		}
+		++_particlesDropped;
+	}
+	_particlesActive.push_back(id);
+	return id;
 }
 
 void MIDIScene::resetParticles() {
-	for (auto & particle : _particles) {
-		particle.note = -1;
-		particle.set = -1;
-		particle.duration = particle.start = particle.elapsed = 0.0f;
+	// Start again from the initial pool, that will grow when needed.
+	_particles.assign((std::min)(size_t(PARTICLES_INITIAL_SYSTEMS), _particlesMaxSystems), Particles());
+	_particlesActive.clear();
+	_particlesFree.resize(_particles.size());
+	for(size_t i = 0; i < _particlesFree.size(); ++i){
+		_particlesFree[i] = _particles.size() - 1 - i;
+	}
+	_particlesSystemsCount = 0;
+}
+
+void MIDIScene::setParticlesMaxSystems(size_t count){
+	const size_t maxSystems = (std::max)(count, size_t(1));
+	if(maxSystems == _particlesMaxSystems){
+		return;
+	}
+	_particlesMaxSystems = maxSystems;
+	// Systems beyond the new maximum can't be kept.
+	if(_particles.size() > _particlesMaxSystems){
+		resetParticles();
 	}
 }
 
@@ -360,16 +502,13 @@ void MIDIScene::drawParticles(float time, const glm::vec2 & invScreenSize, const
 	
 	// Common uniforms values.
 	GLuint screenId = glGetUniformLocation(_programParticulesId, "inverseScreenSize");
-	GLuint timeId = glGetUniformLocation(_programParticulesId, "time");
-	GLuint durationId = glGetUniformLocation(_programParticulesId, "duration");
 	glUniform2fv(screenId,1, &(invScreenSize[0]));
-	glUniform1f(timeId,0.0);
 
 	// Variable uniforms.
-	GLuint globalShiftId = glGetUniformLocation(_programParticulesId, "globalId");
 	GLuint scaleId = glGetUniformLocation(_programParticulesId, "scale");
 	GLuint colorId = glGetUniformLocation(_programParticulesId, "baseColor");
-	GLuint channelId = glGetUniformLocation(_programParticulesId, "channel");
+	GLuint countId = glGetUniformLocation(_programParticulesId, "particlesPerSystem");
+	glUniform1i(countId, state.count);
 	
 	// Prepass : bigger, darker particles.
 	GLuint colorScaleId = glGetUniformLocation(_programParticulesId, "colorScale");
@@ -385,19 +524,17 @@ void MIDIScene::drawParticles(float time, const glm::vec2 & invScreenSize, const
 	glBindTexture(GL_TEXTURE_2D_ARRAY, state.tex);
 	GLuint texCountId = glGetUniformLocation(_programParticulesId, "texCount");
 	glUniform1i(texCountId, state.texCount);
+	// Active particles systems parameters.
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_BUFFER, _texParticlesSystems);
 
 	// Select the geometry.
 	glBindVertexArray(_vaoParticles);
-	// For each activ particles system, draw it with the right parameters.
-	for(const auto & particle : _particles){
-		if(particle.note >= 0){
-			glUniform1i(globalShiftId, particle.note);
-			glUniform1f(timeId, particle.elapsed);
-			glUniform1f(durationId, particle.duration);
-			glUniform1i(channelId, particle.set);
-			glDrawElementsInstanced(GL_TRIANGLES, int(_primitiveCount), GL_UNSIGNED_INT, (void*)0, state.count);
-		}
+	// All active particles systems in a single draw, each system is a run of state.count instances.
+	if(_particlesSystemsCount > 0 && state.count > 0){
+		glDrawElementsInstanced(GL_TRIANGLES, int(_primitiveCount), GL_UNSIGNED_INT, (void*)0, GLsizei(_particlesSystemsCount) * state.count);
 	}
+	glActiveTexture(GL_TEXTURE0);
 	
 	glBindVertexArray(0);
 	glUseProgram(0);
@@ -423,9 +560,13 @@ void MIDIScene::drawNotes(float time, const glm::vec2 & invScreenSize, const Col
 	glUniform3fv(colorMinId, minorColors.size(), &(minorColors[0][0]));
 	
 	
-	// Draw the geometry.
+	// Only draw notes that can be visible: in the displayed time window and keys range, for enabled tracks.
+	const float window = 2.0f / (std::max)(_scale, 0.001f);
+	const float minKey = float(_minKeyMajor) - 1.0f;
+	const float maxKey = float(_minKeyMajor + _keysCount);
 	glBindVertexArray(_vao);
-	glDrawElementsInstanced(GL_TRIANGLES, int(_primitiveCount), GL_UNSIGNED_INT, (void*)0, GLsizei(_midiFile.notesCount()));
+	_notesBuffer.draw(time, window, minKey, maxKey, _tracksEnabled, _primitiveCount);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	glBindVertexArray(0);
 	glUseProgram(0);
@@ -502,7 +643,8 @@ void MIDIScene::drawPedals(float time, const glm::vec2 & invScreenSize, const St
 	bool damper = false;
 	bool sostenuto = false;
 	bool soft = false;
-	_midiFile.getPedalsActive(damper, sostenuto, soft, time, 0),
+	_cursor.update(time);
+	_cursor.getPedalsActive(damper, sostenuto, soft);
 
 	glEnable(GL_BLEND);
 	glUseProgram(_programPedalsId);
@@ -594,6 +736,8 @@ void MIDIScene::drawWaves(float time, const glm::vec2 & invScreenSize, const Sta
 }
 
 void MIDIScene::setMinMaxKeys(int minKey, int minKeyMajor, int notesCount){
+	_minKeyMajor = minKeyMajor;
+	_keysCount = notesCount;
 	glUseProgram(_programId);
 	glUniform1i(glGetUniformLocation(_programId, "minNoteMajor"), minKeyMajor);
 	glUniform1f(glGetUniformLocation(_programId, "notesCount"), float(notesCount));
@@ -610,9 +754,12 @@ void MIDIScene::setMinMaxKeys(int minKey, int minKeyMajor, int notesCount){
 }
 
 void MIDIScene::clean(){
+	_notesBuffer.clean();
 	glDeleteVertexArrays(1, &_vao);
 	glDeleteVertexArrays(1, &_vaoFlashes);
 	glDeleteVertexArrays(1, &_vaoParticles);
+	glDeleteBuffers(1, &_particlesSystemsBuffer);
+	glDeleteTextures(1, &_texParticlesSystems);
 	glDeleteProgram(_programId);
 	glDeleteProgram(_programFlashesId);
 	glDeleteProgram(_programParticulesId);
@@ -3,7 +3,14 @@
 #include <gl3w/gl3w.h>
 #include <glm/glm.hpp>
 #include "../midi/MIDIFile.h"
+#include "../midi/PlaybackCursor.h"
 #include "State.h"
+#include "NotesBuffer.h"
+#include <deque>
+
+// Initial size of the particles systems pool, and default maximum size it can grow to.
+#define PARTICLES_INITIAL_SYSTEMS 256
+#define PARTICLES_DEFAULT_MAX_SYSTEMS 2048
 
 class MIDIScene {
 
@@ -11,9 +18,38 @@ public:
 
 	MIDIScene();
 
-	MIDIScene(const std::string & midiFilePath, const SetOptions & options);
+	/// Load a file and upload its notes, within a GPU memory budget in bytes.
+	MIDIScene(const std::string & midiFilePath, const SetOptions & options, const LoadOptions & loadOptions, size_t notesBudget = size_t(NOTES_DEFAULT_BUDGET) << 20);
+
+	/// Create a scene for an already loaded file, notes data has to be uploaded with startUpload/continueUpload.
+	MIDIScene(MIDIFile && midiFile);
+
+	/// Generate the per-note GPU data of a file, can be called outside of the main thread.
+	/// Notes are split in slices of NOTES_SLICE_SIZE consecutive notes, then in majors and minors, then grouped by source track.
+	/// ranges contains the start of each group, followed by the total count.
+	static void packNotes(const MIDIFile & midiFile, std::vector<GPUNote> & data, std::vector<size_t> & ranges, int threads = 0);
+
+	/// Prepare an upload of notes data, that can be spread over multiple frames.
+	void startUpload(std::vector<GPUNote> && data, std::vector<size_t> && ranges);
 
+	/// Upload at most a given number of bytes of notes data, returns true once all notes data fitting in the budget is uploaded.
+	bool continueUpload(size_t maxSize);
+
+	/// Only updates the notes shader parameters, no data is regenerated.
 	void updateSets(const SetOptions & options);
+
+	/// Hide the notes of some source tracks, or only show one if solo is a valid track. No data is regenerated.
+	/// Pedals are merged from all tracks without their origin, and are always displayed.
+	void setTracksVisibility(const std::vector<int> & hiddenTracks, int soloTrack);
+
+	/// Number of source tracks in the file.
+	size_t tracksCount() const;
+
+	/// Name of a source track, empty if unknown.
+	std::string trackName(size_t track) const;
+
+	/// GPU memory budget for notes, in bytes. Only the notes around the current time are kept on the GPU.
+	void setNotesBudget(size_t budget);
 	
 	~MIDIScene();
 	
@@ -49,11 +85,21 @@ public:
 	
 	void resetParticles();
 
+	/// Set the maximum number of simultaneous particles systems, the oldest one is replaced when all are in use.
+	void setParticlesMaxSystems(size_t count);
+
+	size_t particlesSystemsCount() const { return _particlesActive.size(); }
+
+	/// Number of particles systems replaced before the end of their animation.
+	size_t particlesSystemsDropped() const { return _particlesDropped; }
+
 private:
 
 	void renderSetup();
 
-	void upload(const std::vector<float> & data);
+	/// Get an unused particles system, growing the pool or replacing the oldest system if needed.
+	size_t allocateParticles();
+
 
 	GLuint _programId;
 	GLuint _programFlashesId;
@@ -64,7 +110,6 @@ private:
 	
 	GLuint _vao;
 	GLuint _ebo;
-	GLuint _dataBuffer;
 	
 	GLuint _flagsBufferId;
 	GLuint _vaoFlashes;
@@ -72,6 +117,9 @@ private:
 	
 	GLuint _vaoParticles;
 	GLuint _texParticles;
+	GLuint _particlesSystemsBuffer; ///< Parameters of the active particles systems, read through a buffer texture.
+	GLuint _texParticlesSystems;
+	size_t _particlesSystemsCount = 0; ///< Number of active particles systems uploaded.
 
 	GLuint _vaoKeyboard;
 	GLuint _uboKeyboard;
@@ -83,6 +131,15 @@ private:
 	size_t _countWave;
 	
 	size_t _primitiveCount;
+
+	NotesBuffer _notesBuffer; ///< Notes data, streamed to the GPU around the current time.
+
+	SetOptions _setOptions;
+	std::vector<bool> _tracksEnabled; ///< Visibility of each source track.
+
+	float _scale = 0.5f;
+	int _minKeyMajor = 0;
+	int _keysCount = 75;
 	
 	std::array<int, 128> _actives;
 
@@ -93,10 +150,16 @@ private:
 		float start = 1000000.0f;
 		float elapsed = 0.0f;
 	};
-	std::vector<Particles> _particles;
+	std::vector<Particles> _particles; ///< Pool of particles systems.
+	std::vector<size_t> _particlesFree; ///< Unused systems of the pool.
+	std::deque<size_t> _particlesActive; ///< Systems in use, oldest first.
+	size_t _particlesMaxSystems = PARTICLES_DEFAULT_MAX_SYSTEMS;
+	size_t _particlesDropped = 0;
+	std::vector<glm::vec4> _particlesSystems; ///< Note, set, elapsed time and duration of active particles systems.
 	double _previousTime;
 
 	MIDIFile _midiFile;
+	PlaybackCursor _cursor; ///< Active notes and pedals of the merged track.
 	
 	
 	
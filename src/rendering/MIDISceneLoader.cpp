@@ -0,0 +1,64 @@
+#include "MIDISceneLoader.h"
+
+// Maximum amount of notes data uploaded at each frame.
+#define UPLOAD_SIZE_PER_FRAME (16u << 20)
+
+MIDISceneLoader::MIDISceneLoader(const std::string & midiFilePath, const LoadOptions & loadOptions, size_t notesBudget) : _path(midiFilePath), _status(Status::PARSING), _parseProgress(0.0f), _notesBudget(notesBudget) {
+
+	_worker = std::thread([this, loadOptions](){
+		try {
+			_midiFile.reset(new MIDIFile(_path, loadOptions, [this](float progress){
+				_parseProgress = progress;
+			}));
+			MIDIScene::packNotes(*_midiFile, _data, _ranges, loadOptions.threads);
+		} catch(...){
+			// Failed to load.
+			_midiFile.reset();
+			_status = Status::FAILED;
+			return;
+		}
+		_status = Status::PARSED;
+	});
+}
+
+MIDISceneLoader::~MIDISceneLoader(){
+	if(_worker.joinable()){
+		_worker.join();
+	}
+}
+
+bool MIDISceneLoader::update(){
+	const Status status = _status;
+	if(status == Status::PARSING){
+		return false;
+	}
+	if(status == Status::DONE || status == Status::FAILED){
+		if(_worker.joinable()){
+			_worker.join();
+		}
+		return true;
+	}
+	if(status == Status::PARSED){
+		_worker.join();
+		// Create GPU objects and start uploading.
+		_totalSize = _data.size() * sizeof(GPUNote);
+		_scene = std::make_shared<MIDIScene>(std::move(*_midiFile));
+		_midiFile.reset();
+		_scene->setNotesBudget(_notesBudget);
+		_scene->startUpload(std::move(_data), std::move(_ranges));
+		_status = Status::UPLOADING;
+	}
+	// Upload a part of the data at each frame.
+	if(_scene->continueUpload(UPLOAD_SIZE_PER_FRAME)){
+		_status = Status::DONE;
+		return true;
+	}
+	_uploadedSize += UPLOAD_SIZE_PER_FRAME;
+	return false;
+}
+
+float MIDISceneLoader::progress() const {
+	// Parsing is the longest step.
+	const float uploadProgress = _totalSize == 0 ? 0.0f : (std::min)(float(_uploadedSize) / float(_totalSize), 1.0f);
+	return 0.9f * _parseProgress + 0.1f * uploadProgress;
+}
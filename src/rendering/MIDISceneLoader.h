@@ -0,0 +1,57 @@
+#ifndef MIDISceneLoader_h
+#define MIDISceneLoader_h
+
+#include <atomic>
+#include <thread>
+#include <memory>
+
+#include "MIDIScene.h"
+
+/// Load a MIDI file and prepare its rendering data on a worker thread,
+/// then create the scene and upload its data on the main thread, over several frames.
+class MIDISceneLoader {
+
+public:
+
+	/// Notes are uploaded within a GPU memory budget, in bytes.
+	MIDISceneLoader(const std::string & midiFilePath, const LoadOptions & loadOptions, size_t notesBudget);
+
+	/// Waits for the worker to finish.
+	~MIDISceneLoader();
+
+	/// Advance the loading, to call on the main thread once per frame. Returns true once finished, successfully or not.
+	bool update();
+
+	/// Overall progress, between 0 and 1.
+	float progress() const;
+
+	bool failed() const { return _status == Status::FAILED; }
+
+	/// The loaded scene, only valid once finished.
+	std::shared_ptr<MIDIScene> scene() const { return _scene; }
+
+	const std::string & path() const { return _path; }
+
+private:
+
+	enum class Status : int {
+		PARSING, PARSED, UPLOADING, DONE, FAILED
+	};
+
+	std::string _path;
+	std::thread _worker;
+	std::atomic<Status> _status;
+	std::atomic<float> _parseProgress;
+
+	// Produced by the worker.
+	std::unique_ptr<MIDIFile> _midiFile;
+	std::vector<GPUNote> _data;
+	std::vector<size_t> _ranges;
+
+	std::shared_ptr<MIDIScene> _scene;
+	size_t _notesBudget;
+	size_t _uploadedSize = 0;
+	size_t _totalSize = 0;
+};
+
+#endif
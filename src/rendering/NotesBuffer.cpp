@@ -0,0 +1,267 @@
+#include <iostream>
+#include <algorithm>
+
+#include "../midi/MIDIUtils.h"
+
+#include "NotesBuffer.h"
+
+GPUNote::GPUNote(double aStart, double aDuration, uint8_t aKey, uint8_t aChannel, uint32_t aTrack){
+	const double startUnits = (std::min)((std::max)(aStart * NOTES_START_UNITS + 0.5, 0.0), double(0xFFFFFFFFu));
+	const double durationUnits = (std::min)((std::max)(aDuration * NOTES_DURATION_UNITS + 0.5, 0.0), double(NOTES_DURATION_MAX_UNITS));
+	// Small float: short durations are stored as is, longer ones keep their most significant bits.
+	uint32_t mantissa = uint32_t(durationUnits);
+	uint32_t exponent = 0;
+	if(mantissa >= (1u << NOTES_DURATION_MANTISSA_BITS)){
+		exponent = 1;
+		while(mantissa >= (2u << NOTES_DURATION_MANTISSA_BITS)){
+			mantissa >>= 1;
+			++exponent;
+		}
+		mantissa &= (1u << NOTES_DURATION_MANTISSA_BITS) - 1;
+	}
+	const uint32_t durationBits = (exponent << NOTES_DURATION_MANTISSA_BITS) | mantissa;
+	start = uint32_t(startUnits);
+	infos = uint32_t(aKey & 0x7F) | (noteIsMinor[aKey % 12] ? (1u << 7) : 0u) | (uint32_t(aChannel & 0xF) << 8) | ((aTrack & 0x7) << 12) | (durationBits << 15);
+}
+
+double GPUNote::duration() const {
+	const uint32_t durationBits = infos >> 15;
+	const uint32_t exponent = durationBits >> NOTES_DURATION_MANTISSA_BITS;
+	const uint32_t mantissa = durationBits & ((1u << NOTES_DURATION_MANTISSA_BITS) - 1);
+	const uint32_t units = exponent == 0 ? mantissa : ((mantissa | (1u << NOTES_DURATION_MANTISSA_BITS)) << (exponent - 1));
+	return double(units) / NOTES_DURATION_UNITS;
+}
+
+NotesBuffer::NotesBuffer(){}
+
+void NotesBuffer::setNotes(std::vector<GPUNote> && notes, std::vector<size_t> && ranges, size_t tracksCount){
+	_notes = std::move(notes);
+	_ranges = std::move(ranges);
+	_tracksCount = tracksCount;
+
+	const size_t groupsCount = _ranges.empty() ? 0 : (_ranges.size() - 1);
+	const size_t groupsPerSlice = 2 * _tracksCount;
+	const size_t slicesCount = groupsPerSlice == 0 ? 0 : (groupsCount / groupsPerSlice);
+
+	// Bounds of each group and time span of each slice, used for culling and residency.
+	_bounds.assign(groupsCount, GroupBounds());
+	_spans.assign(slicesCount, SliceSpan());
+	for(size_t sid = 0; sid < slicesCount; ++sid){
+		SliceSpan & span = _spans[sid];
+		span.start = 1e20;
+		span.end = -1e20;
+		for(size_t gid = sid * groupsPerSlice; gid < (sid + 1) * groupsPerSlice; ++gid){
+			GroupBounds & bounds = _bounds[gid];
+			bounds.minKey = 1000.0f;
+			bounds.maxKey = -1000.0f;
+			for(size_t i = _ranges[gid]; i < _ranges[gid + 1]; ++i){
+				const GPUNote & note = _notes[i];
+				const uint8_t key = note.key();
+				const float shiftedKey = float((key/12) * 7 + noteShift[key % 12]);
+				const double start = note.startTime();
+				const double duration = note.duration();
+				bounds.maxDuration = (std::max)(bounds.maxDuration, float(duration));
+				bounds.minKey = (std::min)(bounds.minKey, shiftedKey);
+				bounds.maxKey = (std::max)(bounds.maxKey, shiftedKey);
+				span.start = (std::min)(span.start, start);
+				span.end = (std::max)(span.end, start + duration);
+			}
+		}
+	}
+
+	// Reset residency.
+	const size_t slotSize = NOTES_SLICE_SIZE * sizeof(GPUNote);
+	allocateSlots((std::min)((std::max)(_budget / slotSize, size_t(1)), slicesCount));
+}
+
+void NotesBuffer::setBudget(size_t budget){
+	_budget = budget;
+	const size_t slotSize = NOTES_SLICE_SIZE * sizeof(GPUNote);
+	const size_t count = (std::min)((std::max)(_budget / slotSize, size_t(1)), _spans.size());
+	if(count != _slots.size()){
+		allocateSlots(count);
+	}
+}
+
+void NotesBuffer::allocateSlots(size_t count){
+	if(!_slots.empty()){
+		glDeleteBuffers(GLsizei(_slots.size()), &_slots[0]);
+	}
+	_slots.assign(count, 0);
+	if(count > 0){
+		glGenBuffers(GLsizei(count), &_slots[0]);
+	}
+	for(const GLuint slot : _slots){
+		glBindBuffer(GL_ARRAY_BUFFER, slot);
+		glBufferData(GL_ARRAY_BUFFER, NOTES_SLICE_SIZE * sizeof(GPUNote), nullptr, GL_DYNAMIC_DRAW);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	_slotSlices.assign(count, -1);
+	_sliceSlots.assign(_spans.size(), -1);
+	_nextSlot = 0;
+	_budgetExceeded = false;
+}
+
+void NotesBuffer::update(double time, double window){
+	const double visibleEnd = time + window;
+	// Upcoming slices are prepared one screen ahead.
+	const double aheadEnd = visibleEnd + window;
+	size_t uploads = 0;
+	for(size_t sid = 0; sid < _spans.size(); ++sid){
+		const SliceSpan & span = _spans[sid];
+		// Slices are sorted by start time.
+		if(span.start > aheadEnd){
+			break;
+		}
+		if(span.end < time || _sliceSlots[sid] >= 0){
+			continue;
+		}
+		const bool visible = span.start <= visibleEnd;
+		if(!visible && uploads >= NOTES_UPLOADS_PER_UPDATE){
+			break;
+		}
+		if(!makeResident(sid, time, aheadEnd - time)){
+			if(visible && !_budgetExceeded){
+				std::cerr << "[WARN]: Notes memory budget too small, some notes will not be displayed." << std::endl;
+				_budgetExceeded = true;
+			}
+			break;
+		}
+		uploads += visible ? 0 : 1;
+	}
+}
+
+bool NotesBuffer::preload(size_t maxSize){
+	size_t uploaded = 0;
+	for(size_t sid = 0; sid < _spans.size(); ++sid){
+		if(_sliceSlots[sid] >= 0){
+			continue;
+		}
+		if(uploaded >= maxSize){
+			return false;
+		}
+		// Only fill free slots.
+		if(std::find(_slotSlices.begin(), _slotSlices.end(), -1) == _slotSlices.end()){
+			return true;
+		}
+		makeResident(sid, 0.0, 0.0);
+		uploaded += (_ranges[(sid + 1) * 2 * _tracksCount] - _ranges[sid * 2 * _tracksCount]) * sizeof(GPUNote);
+	}
+	return true;
+}
+
+bool NotesBuffer::makeResident(size_t slice, double time, double window){
+	// Find a free slot, or a slot hosting a slice outside of the needed time range.
+	int slot = -1;
+	for(size_t i = 0; i < _slots.size(); ++i){
+		const size_t candidate = (_nextSlot + i) % _slots.size();
+		const int hosted = _slotSlices[candidate];
+		if(hosted < 0){
+			slot = int(candidate);
+			break;
+		}
+		const SliceSpan & span = _spans[hosted];
+		if(slot < 0 && (span.end < time || span.start > time + window)){
+			slot = int(candidate);
+		}
+	}
+	if(slot < 0){
+		return false;
+	}
+	if(_slotSlices[slot] >= 0){
+		_sliceSlots[_slotSlices[slot]] = -1;
+	}
+	_slotSlices[slot] = int(slice);
+	_sliceSlots[slice] = slot;
+	_nextSlot = (size_t(slot) + 1) % _slots.size();
+
+	const size_t first = _ranges[slice * 2 * _tracksCount];
+	const size_t count = _ranges[(slice + 1) * 2 * _tracksCount] - first;
+	glBindBuffer(GL_ARRAY_BUFFER, _slots[slot]);
+	// Orphan the previous content, that might still be in use by the GPU.
+	glBufferData(GL_ARRAY_BUFFER, NOTES_SLICE_SIZE * sizeof(GPUNote), nullptr, GL_DYNAMIC_DRAW);
+	if(count > 0){
+		glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(GPUNote), &_notes[first]);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return true;
+}
+
+void NotesBuffer::draw(float time, float window, float minKey, float maxKey, const std::vector<bool> & tracksEnabled, size_t primitiveCount){
+	const double lastTime = double(time) + double(window);
+	const size_t tracksCount = _tracksCount;
+	// Without a track filter, the visible notes of all groups are drawn in a single run per slice and pass,
+	// notes of other tracks in between are placed offscreen by the shader.
+	bool filtered = false;
+	for(size_t tid = 0; tid < (std::min)(tracksEnabled.size(), tracksCount); ++tid){
+		filtered = filtered || !tracksEnabled[tid];
+	}
+	// Majors first, then minors on top.
+	for(size_t pass = 0; pass < 2; ++pass){
+		for(size_t sid = 0; sid < _spans.size(); ++sid){
+			const SliceSpan & span = _spans[sid];
+			if(span.start > lastTime){
+				break;
+			}
+			const int slot = _sliceSlots[sid];
+			if(span.end < time || slot < 0){
+				continue;
+			}
+			glBindBuffer(GL_ARRAY_BUFFER, _slots[slot]);
+			const size_t sliceFirst = _ranges[sid * 2 * tracksCount];
+			const size_t groupsBegin = (sid * 2 + pass) * tracksCount;
+
+			// Each group is sorted by start time, and contains notes ending at most maxDuration after their start.
+			// Visible notes of consecutive groups are merged in a single draw, or all of them if no track is hidden.
+			size_t first = 0;
+			size_t last = 0;
+			for(size_t tid = 0; tid <= tracksCount; ++tid){
+				size_t begin = last;
+				size_t end = last;
+				if(tid < tracksCount){
+					const size_t gid = groupsBegin + tid;
+					const GroupBounds & bounds = _bounds[gid];
+					const bool enabled = tracksEnabled.empty() || tid >= tracksEnabled.size() || tracksEnabled[tid];
+					if(!enabled || bounds.maxKey < minKey || bounds.minKey > maxKey){
+						continue;
+					}
+					const double firstStart = double(time) - double(bounds.maxDuration);
+					const auto groupBegin = _notes.begin() + _ranges[gid];
+					const auto groupEnd = _notes.begin() + _ranges[gid + 1];
+					const auto visibleBegin = std::lower_bound(groupBegin, groupEnd, firstStart, [](const GPUNote & note, double t){
+						return note.startTime() < t;
+					});
+					const auto visibleEnd = std::upper_bound(visibleBegin, groupEnd, lastTime, [](double t, const GPUNote & note){
+						return t < note.startTime();
+					});
+					begin = size_t(visibleBegin - _notes.begin());
+					end = size_t(visibleEnd - _notes.begin());
+					if(begin == end){
+						continue;
+					}
+					if(begin == last || (!filtered && last > first)){
+						last = end;
+						continue;
+					}
+				}
+				// Flush the current run of notes.
+				if(last > first){
+					// No base instance in OpenGL 3.3, shift the notes attribute instead.
+					glVertexAttribIPointer(1, 2, GL_UNSIGNED_INT, sizeof(GPUNote), (void*)((first - sliceFirst) * sizeof(GPUNote)));
+					glDrawElementsInstanced(GL_TRIANGLES, int(primitiveCount), GL_UNSIGNED_INT, (void*)0, GLsizei(last - first));
+				}
+				first = begin;
+				last = end;
+			}
+		}
+	}
+}
+
+void NotesBuffer::clean(){
+	if(!_slots.empty()){
+		glDeleteBuffers(GLsizei(_slots.size()), &_slots[0]);
+	}
+	_slots.clear();
+	_slotSlices.clear();
+	_sliceSlots.assign(_spans.size(), -1);
+}
@@ -0,0 +1,101 @@
+#ifndef NotesBuffer_h
+#define NotesBuffer_h
+#include <gl3w/gl3w.h>
+#include <vector>
+#include <cstdint>
+
+// Time resolution of packed notes, in units per second.
+#define NOTES_START_UNITS 4096.0
+#define NOTES_DURATION_UNITS 1024.0
+// Packed durations are exact below 2^14 units (16s), then keep 14 significant bits, up to about 72 hours.
+#define NOTES_DURATION_MANTISSA_BITS 13
+#define NOTES_DURATION_MAX_UNITS (0x3FFFu << 14)
+
+// Number of notes in each time slice, and size of each GPU buffer of the ring.
+#define NOTES_SLICE_SIZE 65536
+// Default GPU memory budget for notes, in megabytes.
+#define NOTES_DEFAULT_BUDGET 512
+// Maximum number of upcoming slices uploaded at each update, slices currently visible are always uploaded.
+#define NOTES_UPLOADS_PER_UPDATE 2
+
+/// Packed per-note GPU data, decoded in the notes shader. The set is computed from the channel, track and key.
+struct GPUNote {
+
+	GPUNote() : start(0), infos(0) {}
+
+	GPUNote(double aStart, double aDuration, uint8_t aKey, uint8_t aChannel, uint32_t aTrack);
+
+	double startTime() const { return double(start) / NOTES_START_UNITS; }
+
+	double duration() const;
+
+	uint8_t key() const { return uint8_t(infos & 0x7F); }
+
+	uint32_t start; ///< Start time, in 1/NOTES_START_UNITS seconds.
+	uint32_t infos; ///< Key (7 bits), minor flag (1 bit), channel (4 bits), track modulo 8 (3 bits), duration in 1/NOTES_DURATION_UNITS seconds (17 bits, 4 bits exponent and 13 bits mantissa).
+};
+
+/// Notes split in time slices of at most NOTES_SLICE_SIZE notes. Only the slices around the playhead
+/// are resident on the GPU, in a ring of fixed-size buffers bounded by a memory budget.
+class NotesBuffer {
+
+public:
+
+	NotesBuffer();
+
+	/// Set the notes, grouped by slice, then majors and minors, then track. Each group is sorted by start time,
+	/// ranges contains the start of each group followed by the total count. All slices are evicted.
+	void setNotes(std::vector<GPUNote> && notes, std::vector<size_t> && ranges, size_t tracksCount);
+
+	/// Set the GPU memory budget in bytes, the ring is reallocated if its size changes.
+	void setBudget(size_t budget);
+
+	/// Make resident the slices visible in [time, time + window], and upload a few of the following ones.
+	void update(double time, double window);
+
+	/// Upload the first slices, at most maxSize bytes. Returns true once the ring is full or all slices are resident.
+	bool preload(size_t maxSize);
+
+	/// Draw the visible notes of enabled tracks in the keys range, majors then minors, with the notes VAO bound.
+	void draw(float time, float window, float minKey, float maxKey, const std::vector<bool> & tracksEnabled, size_t primitiveCount);
+
+	void clean();
+
+	size_t notesCount() const { return _notes.size(); }
+
+private:
+
+	/// Upload a slice in a free slot, or in the slot of a slice not needed anymore. Returns false if no slot is available.
+	bool makeResident(size_t slice, double time, double window);
+
+	void allocateSlots(size_t count);
+
+	/// Bounds of a group of notes.
+	struct GroupBounds {
+		float maxDuration = 0.0f;
+		float minKey = 0.0f; ///< Smallest shifted key.
+		float maxKey = 0.0f; ///< Largest shifted key.
+	};
+
+	/// Time span covered by the notes of a slice.
+	struct SliceSpan {
+		double start = 0.0;
+		double end = 0.0;
+	};
+
+	std::vector<GPUNote> _notes; ///< All notes, resident or not.
+	std::vector<size_t> _ranges; ///< Start of each group in the notes.
+	std::vector<GroupBounds> _bounds;
+	std::vector<SliceSpan> _spans;
+	size_t _tracksCount = 0;
+
+	std::vector<GLuint> _slots; ///< Ring of GPU buffers, each hosting one slice.
+	std::vector<int> _slotSlices; ///< Slice hosted by each slot, -1 if free.
+	std::vector<int> _sliceSlots; ///< Slot hosting each slice, -1 if not resident.
+	size_t _nextSlot = 0; ///< Next slot to consider for eviction.
+	size_t _budget = size_t(NOTES_DEFAULT_BUDGET) << 20;
+	bool _budgetExceeded = false;
+
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "../helpers/ProgramUtilities.h"
 #include "../helpers/ResourcesManager.h"
+#include <algorithm>
 #include <cstring>
 #include <glm/gtc/matrix_transform.hpp>
 #include <imgui/imgui.h>
@@ -120,20 +121,43 @@ bool Renderer::loadFile(const std::string &midiFilePath) {
 	std::shared_ptr<MIDIScene> scene(nullptr);
 
 	try {
-		scene = std::make_shared<MIDIScene>(midiFilePath, _state.setOptions);
+		scene = std::make_shared<MIDIScene>(midiFilePath, _state.setOptions, _state.loadOptions, size_t(_state.notesBudget) << 20);
 	} catch(...){
 		// Failed to load.
 		return false;
 	}
+	setScene(scene);
+	return true;
+}
+
+void Renderer::loadFileAsync(const std::string & midiFilePath) {
+	_loader.reset(new MIDISceneLoader(midiFilePath, _state.loadOptions, size_t(_state.notesBudget) << 20));
+}
+
+void Renderer::setScene(const std::shared_ptr<MIDIScene> & scene) {
 	// Player.
 	_timer = -_state.prerollTime;
 	_shouldPlay = false;
 
+	// Release the GPU resources of the previous scene.
+	_scene->clean();
+	_score->clean();
 	// Init objects.
 	_scene = scene;
 	_score = std::make_shared<Score>(_scene->midiFile().secondsPerMeasure());
 	applyAllSettings();
-	return true;
+}
+
+void Renderer::updateLoading() {
+	if(!_loader || !_loader->update()){
+		return;
+	}
+	if(_loader->failed()){
+		std::cerr << "[ERROR]: Unable to load " << _loader->path() << "." << std::endl;
+	} else {
+		setScene(_loader->scene());
+	}
+	_loader.reset();
 }
 
 SystemAction Renderer::draw(float currentTime) {
@@ -166,6 +190,9 @@ SystemAction Renderer::draw(float currentTime) {
 
 	// -- Default mode --
 
+	// Keep loading in the background.
+	updateLoading();
+
 	// Compute the time elapsed since last frame, or keep the same value if
 	// playback is disabled.
 	_timer = _shouldPlay ? (currentTime - _timerStart) : _timer;
@@ -335,13 +362,15 @@ SystemAction Renderer::drawGUI(const float currentTime) {
 		ImGui::Text("Notes: %d, duration: %.1fs, speed: %d notes/s", nCount, duration, speed);
 		ImGui::Separator();
 		
-		// Load button.
-		if (ImGui::Button("Load MIDI file...")) {
+		// Load button, or progress of the current load.
+		if(_loader){
+			ImGui::ProgressBar(_loader->progress(), ImVec2(COLUMN_SIZE - 10.0f, 0.0f), "Loading...");
+		} else if (ImGui::Button("Load MIDI file...")) {
 			// Read arguments.
 			nfdchar_t *outPath = NULL;
 			nfdresult_t result = NFD_OpenDialog(NULL, NULL, &outPath);
 			if (result == NFD_OKAY) {
-				loadFile(std::string(outPath));
+				loadFileAsync(std::string(outPath));
 			}
 		}
 		ImGui::SameLine(COLUMN_SIZE);
@@ -375,6 +404,16 @@ SystemAction Renderer::drawGUI(const float currentTime) {
 		if(ImGui::Combo("Max key", &_state.maxKey, midiKeysString)){
 			updateMinMaxKeys();
 		}
+		if(ImGui::Button("Fit keys to file")){
+			if(_scene->midiFile().getKeysRange(_state.minKey, _state.maxKey)){
+				updateMinMaxKeys();
+			}
+		}
+		ImGui::SameLine(COLUMN_SIZE);
+		if(ImGui::Button("Tracks...")){
+			ImGui::OpenPopup("Tracks options");
+		}
+		showTracks();
 
 
 
@@ -465,6 +504,7 @@ SystemAction Renderer::drawGUI(const float currentTime) {
 			ImGui::TextDisabled("(press D to hide)");
 			ImGui::Text("%.1f FPS / %.1f ms", ImGui::GetIO().Framerate, ImGui::GetIO().DeltaTime * 1000.0f);
 			ImGui::Text("Render size: %dx%d, screen size: %dx%d", _renderFramebuffer->_width, _renderFramebuffer->_height, _camera.screenSize()[0], _camera.screenSize()[1]);
+			ImGui::Text("Particles bursts: %d, replaced: %d", int(_scene->particlesSystemsCount()), int(_scene->particlesSystemsDropped()));
 			if (ImGui::Button("Print MIDI content to console")) {
 				_scene->midiFile().print();
 			}
@@ -567,6 +607,13 @@ void Renderer::showParticleOptions(){
 	}
 	ImGui::PopItemWidth();
 
+	ImGui::PushItemWidth(100);
+	if (ImGui::InputInt("Max bursts", &_state.particles.maxSystems, 64, 1024)) {
+		_state.particles.maxSystems = std::min(std::max(_state.particles.maxSystems, 1), 65536);
+		_scene->setParticlesMaxSystems(size_t(_state.particles.maxSystems));
+	}
+	ImGui::PopItemWidth();
+
 	const bool mp0 = ImGui::InputFloat("Speed", &_state.particles.speed, 0.001f, 1.0f);
 	ImGui::SameLine(COLUMN_SIZE);
 	const bool mp1 = ImGui::InputFloat(	"Expansion", &_state.particles.expansion, 0.1f, 5.0f);
@@ -882,6 +929,49 @@ void Renderer::showSets(){
 	}
 }
 
+void Renderer::showTracks(){
+	if(ImGui::BeginPopup("Tracks options")){
+		ImGui::Text("Select the tracks whose notes should be displayed,");
+		ImGui::Text("or display only one track with the solo button.");
+		ImGui::Text("Pedals are shared by all tracks and always displayed.");
+
+		bool shouldUpdate = false;
+		if(ImGui::Button("Show all")){
+			_state.hiddenTracks.clear();
+			_state.soloTrack = -1;
+			shouldUpdate = true;
+		}
+		const int tracksCount = int(_scene->tracksCount());
+		for(int tid = 0; tid < tracksCount; ++tid){
+			ImGui::PushID(tid);
+			const auto hidden = std::find(_state.hiddenTracks.begin(), _state.hiddenTracks.end(), tid);
+			bool visible = hidden == _state.hiddenTracks.end();
+			const std::string trackName = _scene->trackName(tid);
+			const std::string name = std::to_string(tid) + ": " + (trackName.empty() ? "Unnamed" : trackName);
+			// Solo button first, as names have various lengths.
+			if(ImGui::RadioButton("Solo", _state.soloTrack == tid)){
+				_state.soloTrack = _state.soloTrack == tid ? -1 : tid;
+				shouldUpdate = true;
+			}
+			ImGui::SameLine();
+			if(ImGui::Checkbox(name.c_str(), &visible)){
+				if(visible){
+					_state.hiddenTracks.erase(hidden);
+				} else {
+					_state.hiddenTracks.push_back(tid);
+				}
+				shouldUpdate = true;
+			}
+			ImGui::PopID();
+		}
+
+		if(shouldUpdate){
+			_scene->setTracksVisibility(_state.hiddenTracks, _state.soloTrack);
+		}
+		ImGui::EndPopup();
+	}
+}
+
 void Renderer::applyAllSettings() {
 	// Apply all modifications.
 
@@ -889,10 +979,14 @@ void Renderer::applyAllSettings() {
 	_scene->setScaleAndMinorWidth(_state.scale, _state.background.minorsWidth);
 	_score->setScaleAndMinorWidth(_state.scale, _state.background.minorsWidth);
 	_scene->setParticlesParameters(_state.particles.speed, _state.particles.expansion);
+	_scene->setParticlesMaxSystems(size_t(_state.particles.maxSystems));
 	_score->setDisplay(_state.background.digits, _state.background.hLines, _state.background.vLines);
 	_score->setColors(_state.background.linesColor, _state.background.textColor, _state.background.keysColor);
 	_scene->setKeyboardSize(_state.keyboard.size);
 	_score->setKeyboardSize(_state.keyboard.size);
+	_scene->updateSets(_state.setOptions);
+	_scene->setTracksVisibility(_state.hiddenTracks, _state.soloTrack);
+	_scene->setNotesBudget(size_t(_state.notesBudget) << 20);
 
 	updateMinMaxKeys();
 
@@ -919,6 +1013,9 @@ void Renderer::applyAllSettings() {
 
 void Renderer::clean() {
 
+	// Wait for any background loading.
+	_loader.reset();
+
 	// Clean objects.
 	_scene->clean();
 	_score->clean();
@@ -996,10 +1093,6 @@ void Renderer::setState(const State & state){
 	_layers[Layer::PEDAL].toggle = &_state.showPedal;
 	_layers[Layer::WAVE].toggle = &_state.showWave;
 
-	// Update split notes.
-	if(_scene){
-		_scene->updateSets(_state.setOptions);
-	}
 	applyAllSettings();
 }
 
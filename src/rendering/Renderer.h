@@ -9,6 +9,7 @@
 #include "Framebuffer.h"
 #include "camera/Camera.h"
 #include "MIDIScene.h"
+#include "MIDISceneLoader.h"
 #include "ScreenQuad.h"
 #include "Score.h"
 
@@ -40,6 +41,9 @@ public:
 	
 	bool loadFile(const std::string & midiFilePath);
 
+	/// Load a file in the background, the current scene is kept until loading is complete.
+	void loadFileAsync(const std::string & midiFilePath);
+
 	void setState(const State & state);
 	
 	/// Draw function
@@ -78,6 +82,11 @@ private:
 
 	};
 
+	void setScene(const std::shared_ptr<MIDIScene> & scene);
+
+	/// Advance background loading, if any, and switch to the new scene once ready.
+	void updateLoading();
+
 	void blurPrepass();
 
 	void drawBackgroundImage(const glm::vec2 & invSize);
@@ -124,6 +133,8 @@ private:
 
 	void showSets();
 
+	void showTracks();
+
 	void applyAllSettings();
 	
 	void reset();
@@ -157,6 +168,7 @@ private:
 	std::shared_ptr<Framebuffer> _finalFramebuffer;
 
 	std::shared_ptr<MIDIScene> _scene;
+	std::unique_ptr<MIDISceneLoader> _loader;
 	ScreenQuad _blurringScreen;
 	ScreenQuad _passthrough;
 	ScreenQuad _backgroundTexture;
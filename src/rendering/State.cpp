@@ -79,6 +79,7 @@ State::OptionInfos::OptionInfos(const std::string & adesc, State::OptionInfos::T
 void State::defineOptions(){
 	// Integers.
 	_sharedInfos["particles-count"] = {"Particles count", OptionInfos::Type::INTEGER, {1.0f, 512.0f}};
+	_sharedInfos["particles-max-systems"] = {"Maximum number of simultaneous particles bursts, the oldest ones are replaced beyond it", OptionInfos::Type::INTEGER, {1.0f, 65536.0f}};
 
 	// Booleans.
 	_sharedInfos["show-particles"] = {"Should particles be shown", OptionInfos::Type::BOOLEAN};
@@ -172,6 +173,18 @@ void State::defineOptions(){
 	_sharedInfos["color-wave"] = {"Wave effect color", OptionInfos::Type::COLOR};
 
 	_sharedInfos["smooth"] = {"Apply anti-aliasing to smooth all lines", OptionInfos::Type::BOOLEAN};
+
+	_sharedInfos["load-threads"] = {"Number of threads used to load MIDI files (0 to use all cores)", OptionInfos::Type::INTEGER, {0.0f, 256.0f}};
+	_sharedInfos["load-note-pairing"] = {"How overlapping notes on the same key and channel are paired", OptionInfos::Type::OTHER, {0.0f, 2.0f}};
+	_sharedInfos["load-note-pairing"].values = "new note ends the previous one: 0, first in first out: 1, last in first out: 2";
+	_sharedInfos["load-cache"] = {"Save loaded notes to a cache file next to the MIDI file, and reuse it on the next load", OptionInfos::Type::BOOLEAN};
+	_sharedInfos["load-deduplicate"] = {"Collapse identical notes of a track (same key, start and end) into a single note", OptionInfos::Type::BOOLEAN};
+	_sharedInfos["load-duplicate-tolerance"] = {"Maximum start and end time differences of notes collapsed together, in seconds", OptionInfos::Type::FLOAT, {0.0f, 0.1f}};
+
+	_sharedInfos["tracks-hidden"] = {"Indices of the tracks whose notes are hidden", OptionInfos::Type::OTHER};
+	_sharedInfos["tracks-hidden"].values = "list of track indices, starting at 0";
+	_sharedInfos["track-solo"] = {"Only display the notes of this track (-1 to display all tracks)", OptionInfos::Type::INTEGER, {-1.0f, 65535.0f}};
+	_sharedInfos["notes-memory-budget"] = {"GPU memory used for notes, in megabytes; notes are streamed around the current time when they do not fit", OptionInfos::Type::INTEGER, {1.0f, 65536.0f}};
 	
 }
 
@@ -214,6 +227,7 @@ void State::updateOptions(){
 	}
 
 	_intInfos["particles-count"] = &particles.count;
+	_intInfos["particles-max-systems"] = &particles.maxSystems;
 	_boolInfos["show-particles"] = &showParticles;
 	_boolInfos["show-flashes"] = &showFlashes;
 	_boolInfos["show-blur"] = &showBlur;
@@ -282,6 +296,15 @@ void State::updateOptions(){
 
 	_boolInfos["smooth"] = &applyAA;
 
+	_intInfos["load-threads"] = &loadOptions.threads;
+	_intInfos["load-note-pairing"] = (int*)&loadOptions.pairing;
+	_boolInfos["load-cache"] = &loadOptions.cache;
+	_boolInfos["load-deduplicate"] = &loadOptions.deduplicate;
+	_floatInfos["load-duplicate-tolerance"] = &loadOptions.duplicateTolerance;
+
+	_intInfos["track-solo"] = &soloTrack;
+	_intInfos["notes-memory-budget"] = &notesBudget;
+
 }
 
 
@@ -340,6 +363,16 @@ void State::save(const std::string & path){
 	}
 	configFile << std::endl;
 
+	if(!hiddenTracks.empty()){
+		configFile << std::endl << "# " << _sharedInfos["tracks-hidden"].description << " (";
+		configFile << _sharedInfos["tracks-hidden"].values << ")" << std::endl;
+		configFile << "tracks-hidden: ";
+		for(size_t i = 0; i < hiddenTracks.size(); ++i){
+			configFile << hiddenTracks[i] << (i != (hiddenTracks.size() - 1) ? " " : "");
+		}
+		configFile << std::endl;
+	}
+
 	configFile.close();
 }
 
@@ -414,6 +447,14 @@ void State::load(const Arguments & configArgs){
 			continue;
 		}
 
+		if(key == "tracks-hidden"){
+			hiddenTracks.clear();
+			for(const auto & value : arg.second){
+				hiddenTracks.push_back(Configuration::parseInt(value));
+			}
+			continue;
+		}
+
 		const auto itf = _floatInfos.find(key);
 		if(itf != _floatInfos.end()){
 			const auto & opt = itf->second;
@@ -511,6 +552,7 @@ void State::reset(){
 	particles.expansion = 1.0f;
 	particles.scale = 1.0f;
 	particles.count = 256;
+	particles.maxSystems = PARTICLES_DEFAULT_MAX_SYSTEMS;
 	const GLuint blankID = ResourcesManager::getTextureFor("blankarray");
 	particles.tex = blankID;
 	particles.texCount = 1;
@@ -526,6 +568,10 @@ void State::reset(){
 	}
 
 	setOptions = SetOptions();
+	loadOptions = LoadOptions();
+	hiddenTracks.clear();
+	soloTrack = -1;
+	notesBudget = NOTES_DEFAULT_BUDGET;
 
 	minKey = 21;
 	maxKey = 108;
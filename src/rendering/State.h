@@ -71,6 +71,7 @@ public:
 		float expansion; ///< Expansion factor.
 		float scale; ///< Particles scale.
 		int count; ///< Number of particles.
+		int maxSystems; ///< Maximum number of simultaneous particles systems.
 	};
 
 	struct KeyboardState {
@@ -106,6 +107,7 @@ public:
 	ParticlesState particles;
 	KeyboardState keyboard;
 	SetOptions setOptions;
+	LoadOptions loadOptions;
 	PedalsState pedals;
 	WaveState waves;
 	
@@ -118,6 +120,10 @@ public:
 	float flashSize; ///< Size of flashes.
 	float prerollTime; ///< Preroll time.
 
+	std::vector<int> hiddenTracks; ///< Tracks whose notes are not displayed.
+	int soloTrack; ///< If valid, only this track is displayed.
+	int notesBudget; ///< GPU memory for notes, in megabytes.
+
 	int minKey; ///< The lowest key to display.
 	int maxKey; ///< The highest key to display.
 